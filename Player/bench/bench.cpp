@@ -0,0 +1,474 @@
+#include <iostream>
+#include <iomanip>
+#include <string>
+#include <vector>
+#include <random>
+#include <chrono>
+#include <utility>
+#include <stdexcept>
+#include <algorithm>
+#include <fstream>
+#include <sstream>
+#include <thread>
+#include "clim_writer.h"
+#include "clim_decoder.h"
+#include "frame.h"
+#include "huffman_codebook.h"
+#include "huffman_decoder.h"
+#include "filesystem.h"
+
+using namespace std;
+
+/**
+ * @struct BenchOptions
+ * @brief Settings shared by the benchmarks.
+ */
+struct BenchOptions {
+    size_t width = 640;		///< Width of the generated videos in pixels.
+    size_t height = 360;	///< Height of the generated videos in pixels.
+    size_t frames = 120;	///< Frames of the generated videos.
+    size_t repeat = 5;		///< Runs of each measure (the fastest one is reported).
+    size_t threads = max<size_t>(2, thread::hardware_concurrency());	///< Decoding threads of the parallel measures.
+    string folder = "./.clim_bench/";	///< Folder of the generated files (deleted at the end).
+    vector<string> benchmarks;	///< Benchmarks to run (all if empty).
+
+    /**
+     * @brief Checks whether a benchmark has been selected.
+     * @param name The name of the benchmark.
+     * @return True if it must run.
+     */
+    bool selected(const string& name) const {
+        return benchmarks.empty() || find(benchmarks.begin(), benchmarks.end(), name) != benchmarks.end();
+    }
+};
+
+typedef chrono::steady_clock Clock;
+
+/**
+ * @brief Gets the seconds elapsed since a time point.
+ * @param start The time point.
+ * @return The elapsed seconds.
+ */
+static double seconds_since(const Clock::time_point& start) {
+    return chrono::duration<double>(Clock::now() - start).count();
+}
+
+/**
+ * @brief Generates a palette of random colors.
+ * @param size The number of colors.
+ * @param random The random generator.
+ * @return The palette.
+ */
+static vector<Color> generate_palette(const size_t size, mt19937& random) {
+    vector<Color> colors;
+    for (size_t i = 0; i < size; ++i) {
+        colors.push_back(Color(random() & 0xFF, random() & 0xFF, random() & 0xFF));
+    }
+    return colors;
+}
+
+/**
+ * @brief Generates frames of noise, the first colors of the palette being the most frequent (short codes).
+ * @param options The benchmark settings (frame dimensions).
+ * @param count The number of frames.
+ * @param colors The number of colors of the palette.
+ * @param random The random generator.
+ * @return The frames.
+ */
+static vector<vector<uint8_t>> generate_noise(const BenchOptions& options, const size_t count, const size_t colors,
+                                              mt19937& random) {
+    geometric_distribution<size_t> color(0.3);
+    vector<vector<uint8_t>> frames(count, vector<uint8_t>(options.width * options.height));
+    for (vector<uint8_t>& frame : frames) {
+        for (uint8_t& pixel : frame) {
+            pixel = static_cast<uint8_t>(min(color(random), colors - 1));
+        }
+    }
+    return frames;
+}
+
+/**
+ * @brief Generates frames of runs of 1 to 40 pixels (across rows), of uniformly distributed colors.
+ * @param options The benchmark settings (frame dimensions).
+ * @param count The number of frames.
+ * @param colors The number of colors of the palette.
+ * @param random The random generator.
+ * @return The frames.
+ */
+static vector<vector<uint8_t>> generate_runs(const BenchOptions& options, const size_t count, const size_t colors,
+                                             mt19937& random) {
+    uniform_int_distribution<size_t> color(0, colors - 1), length(1, 40);
+    vector<vector<uint8_t>> frames(count, vector<uint8_t>(options.width * options.height));
+    for (vector<uint8_t>& frame : frames) {
+        for (size_t pixel = 0; pixel < frame.size();) {
+            size_t end = min(frame.size(), pixel + length(random));
+            fill(frame.begin() + pixel, frame.begin() + end, static_cast<uint8_t>(color(random)));
+            pixel = end;
+        }
+    }
+    return frames;
+}
+
+/**
+ * @brief Writes a generated video, its clusters being of 30 frames (at most): noise for Huffman-only frames
+ *        (the encoder picks them when runs are short), runs otherwise.
+ * @param options The benchmark settings.
+ * @param file_path The path to the file.
+ * @param encoding The encoding of the frames.
+ * @param random The random generator.
+ */
+static void write_video(const BenchOptions& options, const string& file_path, const CLIMWriter::Encoding encoding,
+                        mt19937& random) {
+    const size_t CLUSTER_FRAMES = 30, COLORS = 16;
+    CLIMWriter writer(options.width, options.height);
+    for (size_t frame = 0; frame < options.frames; frame += CLUSTER_FRAMES) {
+        size_t count = min(CLUSTER_FRAMES, options.frames - frame);
+        vector<vector<uint8_t>> frames = encoding == CLIMWriter::Encoding::HUFFMAN
+                                         ? generate_noise(options, count, COLORS, random)
+                                         : generate_runs(options, count, COLORS, random);
+        writer.add_cluster(generate_palette(COLORS, random), frames, encoding);
+    }
+    writer.write(file_path);
+}
+
+/**
+ * @brief Measures the decoding of every frame of a file.
+ * @param options The benchmark settings.
+ * @param name The name of the measure.
+ * @param file_path The path to the file.
+ */
+static void bench_decode(const BenchOptions& options, const string& name, const string& file_path) {
+    CLIMDecoder decoder(file_path, options.folder);
+    StandardFormatInfo info = decoder.get_info();
+    FramePool pool;
+    pool.setup(info.width, info.height, 2);
+    double best = 0;
+    size_t frames = 0;
+    for (size_t run = 0; run < options.repeat; ++run) {
+        decoder.set_cluster_for_frame(0);
+        FrameHandle frame;
+        frames = 0;
+        Clock::time_point start = Clock::now();
+        while (decoder.next_frame(frame, pool)) {
+            ++frames;
+        }
+        double seconds = seconds_since(start);
+        best = run == 0 ? seconds : min(best, seconds);
+    }
+    cout << "decode " << left << setw(30) << name << right << fixed << setprecision(1)
+         << setw(10) << frames / best << " frames/s" << setprecision(3)
+         << setw(10) << best * 1e9 / (static_cast<double>(frames) * info.width * info.height) << " ns/px\n";
+}
+
+/**
+ * @brief Measures the decoding of every frame of a file by worker threads (the decoder is set up beforehand).
+ * @param options The benchmark settings.
+ * @param file_path The path to the file.
+ * @param frames Output parameter to hold the decoded frames.
+ * @return The decoding time in seconds.
+ */
+static double time_threads(const BenchOptions& options, const string& file_path, size_t& frames) {
+    CLIMDecoder decoder(file_path, options.folder);
+    StandardFormatInfo info = decoder.get_info();
+    FramePool pool;
+    pool.setup(info.width, info.height, decoder.get_total_frames() + 2);
+    decoder.set_decoding_threads(options.threads, decoder.get_total_frames());
+    FrameHandle frame;
+    frames = 0;
+    Clock::time_point start = Clock::now();
+    while (decoder.next_frame(frame, pool)) {
+        ++frames;
+    }
+    return seconds_since(start);
+}
+
+/**
+ * @brief Measures the parallel decoding of a file as on its first playback, without its cluster index: the scan of
+ *        the cluster boundaries alone (a seek to the last cluster), the decoding by worker threads, which scan ahead
+ *        for the boundaries, then the same decoding once the index is saved.
+ * @param options The benchmark settings.
+ * @param name The name of the measure.
+ * @param file_path The path to the file.
+ */
+static void bench_parallel(const BenchOptions& options, const string& name, const string& file_path) {
+    namespace fs = std::filesystem;
+    const string index_path = file_path.substr(0, file_path.rfind(".clim")) + ".climidx";
+    double scan_best = 0, scanned_best = 0, indexed_best = 0;
+    size_t scanned_frames = 0, frames = 0, pixels = options.width * options.height;
+    for (size_t run = 0; run < options.repeat; ++run) {
+        fs::delete_file(index_path);
+        {
+            CLIMDecoder decoder(file_path, options.folder);
+            Clock::time_point start = Clock::now();
+            decoder.set_cluster_for_frame(decoder.get_total_frames() - 1);
+            double seconds = seconds_since(start);
+            scan_best = run == 0 ? seconds : min(scan_best, seconds);
+            scanned_frames = decoder.get_cluster_starting_frame();
+        }
+        fs::delete_file(index_path);  // the clusters found by the seek were saved
+        double seconds = time_threads(options, file_path, frames);
+        scanned_best = run == 0 ? seconds : min(scanned_best, seconds);
+        seconds = time_threads(options, file_path, frames);  // the whole index was saved by the previous decoding
+        indexed_best = run == 0 ? seconds : min(indexed_best, seconds);
+    }
+    const pair<string, pair<double, size_t>> rows[] = {
+        {name + " scan", {scan_best, scanned_frames}},
+        {name + " " + to_string(options.threads) + " threads", {scanned_best, frames}},
+        {name + " " + to_string(options.threads) + " threads indexed", {indexed_best, frames}}};
+    for (const pair<string, pair<double, size_t>>& row : rows) {
+        double seconds = row.second.first;
+        cout << "decode " << left << setw(30) << row.first << right << fixed << setprecision(1)
+             << setw(10) << row.second.second / seconds << " frames/s" << setprecision(3)
+             << setw(10) << seconds * 1e9 / (static_cast<double>(row.second.second) * pixels) << " ns/px\n";
+    }
+}
+
+/**
+ * @brief Renders a frame as the player did before the escape code tables: an escape code formatted through a
+ *        string stream for every pixel (24-bit colors).
+ * @param frame The frame.
+ * @return The rendered frame.
+ */
+static string render_reference(const Frame& frame) {
+    ostringstream oss;
+    for (size_t y = 0; y < frame.height; ++y) {
+        for (size_t x = 0; x < frame.width; ++x) {
+            const Color& pixel = frame.color(x, y);
+            oss << "\033[48;2;" << static_cast<int>(pixel.r) << ";" << static_cast<int>(pixel.g) << ";"
+                << static_cast<int>(pixel.b) << "m ";
+        }
+        oss << "\033[0m\n";
+    }
+    return oss.str();
+}
+
+/**
+ * @brief Prints the result of a rendering benchmark.
+ * @param name The name of the rendering setting.
+ * @param bytes The bytes rendered by a run.
+ * @param seconds The time of the fastest run.
+ * @param pixels The pixels rendered by a run.
+ */
+static void print_render(const string& name, const size_t bytes, const double seconds, const double pixels) {
+    cout << "render " << left << setw(36) << name << right << fixed << setprecision(1)
+         << setw(10) << bytes / seconds / 1e6 << " MB/s" << setprecision(3)
+         << setw(10) << seconds * 1e9 / pixels << " ns/px\n";
+}
+
+/**
+ * @brief Measures the rendering of frames with a rendering setting.
+ * @param options The benchmark settings.
+ * @param frames The frames.
+ * @param render The rendering setting.
+ * @param bytes Output parameter to hold the bytes rendered by a run.
+ * @return The time of the fastest run in seconds.
+ */
+static double time_render(const BenchOptions& options, const vector<FrameHandle>& frames, const RenderOptions& render,
+                          size_t& bytes) {
+    FrameRenderer renderer(frames[0]->width, frames[0]->height, render);
+    double best = 0;
+    for (size_t run = 0; run < options.repeat; ++run) {
+        renderer.reset();
+        bytes = 0;
+        Clock::time_point start = Clock::now();
+        for (const FrameHandle& frame : frames) {
+            bytes += renderer.render_frame(*frame).size();
+        }
+        double seconds = seconds_since(start);
+        best = run == 0 ? seconds : min(best, seconds);
+    }
+    return best;
+}
+
+/**
+ * @brief Measures the rendering of every frame of a file in full, with each rendering setting (and with the string
+ *        stream of the first renderer, for reference), then with the delta detection of the default settings.
+ * @param options The benchmark settings.
+ * @param file_path The path to the file.
+ */
+static void bench_render(const BenchOptions& options, const string& file_path) {
+    CLIMDecoder decoder(file_path, options.folder);
+    StandardFormatInfo info = decoder.get_info();
+    FramePool pool;
+    pool.setup(info.width, info.height, options.frames);
+    vector<FrameHandle> frames;
+    FrameHandle frame;
+    while (decoder.next_frame(frame, pool)) {
+        frames.push_back(std::move(frame));
+    }
+    const double pixels = static_cast<double>(frames.size()) * info.width * info.height;
+
+    double best = 0;
+    size_t bytes = 0;
+    for (size_t run = 0; run < options.repeat; ++run) {
+        bytes = 0;
+        Clock::time_point start = Clock::now();
+        for (const FrameHandle& rendered : frames) {
+            bytes += render_reference(*rendered).size();
+        }
+        double seconds = seconds_since(start);
+        best = run == 0 ? seconds : min(best, seconds);
+    }
+    print_render("reference (string stream)", bytes, best, pixels);
+
+    const pair<RenderStrategy, const char*> strategies[] = {
+        {RenderStrategy::SPACES, "spaces"}, {RenderStrategy::HALF_BLOCKS, "half_blocks"}};
+    const pair<EscapeMode, const char*> escape_modes[] = {
+        {EscapeMode::PER_RUN, "per_run"}, {EscapeMode::PER_PIXEL, "per_pixel"}};
+    const pair<ColorMode, const char*> color_modes[] = {
+        {ColorMode::TRUE_COLOR, "truecolor"}, {ColorMode::COLORS_256, "256"}, {ColorMode::COLORS_16, "16"}};
+    for (const pair<RenderStrategy, const char*>& strategy : strategies) {
+      for (const pair<EscapeMode, const char*>& escape_mode : escape_modes) {
+        for (const pair<ColorMode, const char*>& color_mode : color_modes) {
+            RenderOptions render;
+            render.strategy = strategy.first;
+            render.escape_mode = escape_mode.first;
+            render.color_mode = color_mode.first;
+            render.redraw_threshold = 0;  // full redraws: the cost of formatting every cell
+            best = time_render(options, frames, render, bytes);
+            print_render(string(strategy.second) + " " + escape_mode.second + " " + color_mode.second,
+                         bytes, best, pixels);
+        }
+      }
+    }
+    // Every cell of the generated frames changes: the changes are looked for, then the frames are redrawn in full
+    for (const pair<RenderStrategy, const char*>& strategy : strategies) {
+        RenderOptions render;
+        render.strategy = strategy.first;
+        best = time_render(options, frames, render, bytes);
+        print_render(string(strategy.second) + " per_run truecolor delta", bytes, best, pixels);
+    }
+}
+
+/**
+ * @brief Measures the resolution of palette codes: bit by bit through the string codebook, and through the table.
+ * @param options The benchmark settings.
+ * @param random The random generator.
+ */
+static void bench_symbols(const BenchOptions& options, mt19937& random) {
+    const size_t COLORS = 64, SYMBOLS = 1 << 20;
+    vector<size_t> frequencies(COLORS);
+    for (size_t i = 0; i < COLORS; ++i) {
+        frequencies[i] = 1 + (COLORS - i) * (COLORS - i);
+    }
+    vector<string> codes = CLIMWriter::huffman_codes(frequencies, 8);
+    discrete_distribution<size_t> symbol(frequencies.begin(), frequencies.end());
+    BitWriter stream;
+    for (size_t i = 0; i < SYMBOLS; ++i) {
+        stream.write_code(codes[symbol(random)]);
+    }
+    string file_path = options.folder + "symbols.bin";
+    ofstream file(file_path, ios::binary);
+    file.write(reinterpret_cast<const char*>(stream.get_bytes().data()), stream.get_bytes().size());
+    file.close();
+
+    HuffmanCodebook<size_t> codebook;
+    HuffmanDecoder<size_t> decoder;
+    for (size_t i = 0; i < COLORS; ++i) {
+        codebook.insert(codes[i], i);
+        decoder.insert(static_cast<uint32_t>(stoul(codes[i], nullptr, 2)), codes[i].size(), i);
+    }
+    decoder.build();
+
+    BinaryReader reader(file_path, 1 << 16, 1 << 8);
+    double string_best = 0, table_best = 0;
+    size_t string_sum = 0, table_sum = 0;
+    for (size_t run = 0; run < options.repeat; ++run) {
+        BitReader string_bits(reader);
+        string_sum = 0;
+        Clock::time_point start = Clock::now();
+        for (size_t i = 0; i < SYMBOLS; ++i) {
+            string code;
+            while (!codebook.contains(code)) {
+                code += string_bits.read_bit_bool() ? '1' : '0';
+            }
+            string_sum += codebook.at(code);
+        }
+        double seconds = seconds_since(start);
+        string_best = run == 0 ? seconds : min(string_best, seconds);
+
+        BitReader table_bits(reader);
+        table_sum = 0;
+        start = Clock::now();
+        for (size_t i = 0; i < SYMBOLS; ++i) {
+            table_sum += decoder.value(decoder.decode_symbol(table_bits));
+        }
+        seconds = seconds_since(start);
+        table_best = run == 0 ? seconds : min(table_best, seconds);
+    }
+    if (string_sum != table_sum) {
+        throw runtime_error("the string codebook and the table decoded different symbols");
+    }
+    cout << "symbols string codebook " << fixed << setprecision(2) << setw(8) << string_best * 1e9 / SYMBOLS << " ns/symbol\n"
+         << "symbols table           " << setw(8) << table_best * 1e9 / SYMBOLS << " ns/symbol ("
+         << setprecision(1) << string_best / table_best << "x)\n";
+}
+
+int main(int argc, char* argv[]) {
+    namespace fs = std::filesystem;
+    BenchOptions options;
+    try {
+        for (int i = 1; i < argc; ++i) {
+            string arg = argv[i];
+            if (arg == "--width" && i + 1 < argc) {
+                options.width = stoul(argv[++i]);
+            } else if (arg == "--height" && i + 1 < argc) {
+                options.height = stoul(argv[++i]);
+            } else if (arg == "--frames" && i + 1 < argc) {
+                options.frames = stoul(argv[++i]);
+            } else if (arg == "--repeat" && i + 1 < argc) {
+                options.repeat = stoul(argv[++i]);
+            } else if (arg == "--threads" && i + 1 < argc) {
+                options.threads = stoul(argv[++i]);
+            } else if (arg == "symbols" || arg == "decode" || arg == "render") {
+                options.benchmarks.push_back(arg);
+            } else {
+                throw invalid_argument("Unknown argument: " + arg);
+            }
+        }
+        if (!options.width || !options.height || !options.frames || !options.repeat || !options.threads) {
+            throw invalid_argument("the dimensions, frames, runs and threads must be positive");
+        }
+        if (!fs::ensure_directory_existence(options.folder)) {
+            throw runtime_error("unable to create " + options.folder);
+        }
+
+        mt19937 random(2024);  // fixed seed: the same files on every run
+        cout << "Generated videos: " << options.width << "x" << options.height << ", " << options.frames
+             << " frames, fastest of " << options.repeat << " runs\n";
+        if (options.selected("symbols")) {
+            bench_symbols(options, random);
+        }
+        if (options.selected("decode")) {
+            // A video per encoding: each one has its own decoding loop
+            const pair<CLIMWriter::Encoding, const char*> encodings[] = {
+                {CLIMWriter::Encoding::HUFFMAN, "huffman"}, {CLIMWriter::Encoding::RLE, "rle"},
+                {CLIMWriter::Encoding::RLE_HUFFMAN, "rle_huffman"}};
+            for (const pair<CLIMWriter::Encoding, const char*>& encoding : encodings) {
+                string file_path = options.folder + encoding.second + ".clim";
+                write_video(options, file_path, encoding.first, random);
+                bench_decode(options, encoding.second, file_path);
+                bench_parallel(options, encoding.second, file_path);
+            }
+        }
+        if (options.selected("render")) {
+            string file_path = options.folder + "render.clim";
+            write_video(options, file_path, CLIMWriter::Encoding::RLE_HUFFMAN, random);
+            bench_render(options, file_path);
+        }
+
+    } catch (const exception& e) {
+        cerr << "Fatal error: " << e.what() << "\n"
+             << "Syntax: bench [--width PIXELS] [--height PIXELS] [--frames N] [--repeat N] [--threads N] [symbols] [decode] [render]\n"
+             << "  [--width PIXELS], [--height PIXELS]: dimensions of the generated videos (default: 640x360). Optional.\n"
+             << "  [--frames N]: frames of the generated videos (default: 120). Optional.\n"
+             << "  [--repeat N]: runs of each measure, the fastest one is reported (default: 5). Optional.\n"
+             << "  [--threads N]: decoding threads of the parallel measures (default: one per core, at least 2). Optional.\n"
+             << "  [symbols] [decode] [render]: benchmarks to run: palette codes resolution, decoding of each encoding\n"
+             << "    (frames/s), rendering of every setting in full (MB/s of output) (default: all). Optional.\n";
+        fs::ensure_directory_removal(options.folder);
+        return 1;
+    }
+    fs::ensure_directory_removal(options.folder);
+    return 0;
+}
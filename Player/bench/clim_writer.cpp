@@ -0,0 +1,238 @@
+#include "clim_writer.h"
+#include <fstream>
+#include <queue>
+#include <map>
+#include <algorithm>
+#include <stdexcept>
+
+void BitWriter::write_bits(const uint64_t value, const size_t n) {
+    for (size_t i = n; i > 0; --i) {
+        if (bit_count % 8 == 0) {
+            bytes.push_back(0);
+        }
+        if ((value >> (i - 1)) & 1) {
+            bytes.back() |= static_cast<uint8_t>(0x80 >> (bit_count % 8));
+        }
+        ++bit_count;
+    }
+}
+
+void BitWriter::write_code(const std::string& code) {
+    for (char bit : code) {
+        write_bits(bit == '1', 1);
+    }
+}
+
+void BitWriter::align_to_byte() {
+    bit_count = bytes.size() * 8;
+}
+
+void CLIMWriter::add_cluster(const std::vector<Color>& colors, const std::vector<std::vector<uint8_t>>& frames,
+                             const Encoding encoding) {
+    if (colors.empty() || colors.size() > 256 || frames.empty()) {
+        throw std::invalid_argument("a cluster needs 1 to 256 colors and at least a frame");
+    }
+    std::vector<size_t> frequencies(colors.size(), 0);
+    for (const std::vector<uint8_t>& frame : frames) {
+        if (frame.size() != width * height) {
+            throw std::invalid_argument("frame of " + std::to_string(frame.size()) + " pixels in a video of "
+                                        + std::to_string(width) + "x" + std::to_string(height));
+        }
+        for (uint8_t pixel : frame) {
+            if (pixel >= colors.size()) {
+                throw std::invalid_argument("pixel out of the palette: " + std::to_string(pixel));
+            }
+            ++frequencies[pixel];
+        }
+    }
+    std::vector<std::string> codes = huffman_codes(frequencies, 8);
+
+    // Palette: colors, code lengths, codes (each part byte-aligned)
+    clusters.write_bits(colors.size() - 1, 8);
+    for (const Color& color : colors) {
+        clusters.write_bits(color.r, 8);
+        clusters.write_bits(color.g, 8);
+        clusters.write_bits(color.b, 8);
+    }
+    for (const std::string& code : codes) {
+        clusters.write_bits(code.size() - 1, 3);
+    }
+    clusters.align_to_byte();
+    for (const std::string& code : codes) {
+        clusters.write_code(code);
+    }
+    clusters.align_to_byte();
+
+    for (const std::vector<uint8_t>& frame : frames) {
+        write_frame(frame, codes, encoding, clusters);
+    }
+    cluster_dimensions.push_back(frames.size());
+}
+
+void CLIMWriter::write(const std::string& file_path) const {
+    if (cluster_dimensions.empty()) {
+        throw std::runtime_error("no clusters to write");
+    }
+    BitWriter header;
+    size_t clusters_bits = bit_length(cluster_dimensions.size());
+    size_t dimensions_bits = bit_length(*std::max_element(cluster_dimensions.begin(), cluster_dimensions.end()));
+    header.write_bits(clusters_bits - 1, 5);
+    header.write_bits(cluster_dimensions.size() - 1, clusters_bits);
+    header.write_bits(dimensions_bits - 1, 5);
+    for (size_t dimension : cluster_dimensions) {
+        header.write_bits(dimension - 1, dimensions_bits);
+    }
+    header.align_to_byte();
+
+    // Mode, standard format header, clustering header, clusters, then the audio (a placeholder)
+    const size_t STANDARD_HEADER_SIZE = 12;
+    BitWriter format;
+    format.write_bits(1, 8);
+    format.write_bits(width, 16);
+    format.write_bits(height, 16);
+    format.write_bits(milliseconds_between_frames, 16);
+    format.write_bits(STANDARD_HEADER_SIZE + header.get_bytes().size() + clusters.get_bytes().size(), 40);
+    const std::string audio = "no audio";
+
+    std::ofstream file(file_path, std::ios::binary);
+    const BitWriter* parts[] = {&format, &header, &clusters};
+    for (const BitWriter* part : parts) {
+        file.write(reinterpret_cast<const char*>(part->get_bytes().data()), part->get_bytes().size());
+    }
+    file.write(audio.data(), audio.size());
+    if (!file) {
+        throw std::runtime_error("unable to write " + file_path);
+    }
+}
+
+std::vector<std::string> CLIMWriter::huffman_codes(const std::vector<size_t>& frequencies, const size_t max_length) {
+    const size_t count = frequencies.size();
+    std::vector<size_t> lengths(count, 1);
+    if (count > 1) {
+        // Merge the two lightest nodes until one is left, then take the depth of every leaf
+        typedef std::pair<size_t, size_t> Node;  // weight, index (leaves first)
+        std::priority_queue<Node, std::vector<Node>, std::greater<Node>> nodes;
+        std::vector<size_t> parents(count, 0);
+        for (size_t i = 0; i < count; ++i) {
+            nodes.push(Node(std::max<size_t>(frequencies[i], 1), i));
+        }
+        while (nodes.size() > 1) {
+            Node first = nodes.top();
+            nodes.pop();
+            Node second = nodes.top();
+            nodes.pop();
+            parents[first.second] = parents[second.second] = parents.size();
+            nodes.push(Node(first.first + second.first, parents.size()));
+            parents.push_back(0);
+        }
+        const size_t root = parents.size() - 1;
+        size_t fixed_length = bit_length(count - 1);
+        for (size_t i = 0; i < count; ++i) {
+            lengths[i] = 0;
+            for (size_t node = i; node != root; node = parents[node]) {
+                ++lengths[i];
+            }
+            if (lengths[i] > max_length) {
+                std::fill(lengths.begin(), lengths.end(), fixed_length);
+                break;
+            }
+        }
+    }
+
+    // Canonical codes: by increasing length, then by symbol
+    std::vector<size_t> order(count);
+    for (size_t i = 0; i < count; ++i) {
+        order[i] = i;
+    }
+    std::stable_sort(order.begin(), order.end(), [&lengths](size_t a, size_t b) { return lengths[a] < lengths[b]; });
+    std::vector<std::string> codes(count);
+    uint64_t code = 0;
+    size_t length = lengths[order[0]];
+    for (size_t i = 0; i < count; ++i) {
+        size_t symbol = order[i];
+        code <<= lengths[symbol] - length;
+        length = lengths[symbol];
+        for (size_t bit = length; bit > 0; --bit) {
+            codes[symbol] += ((code >> (bit - 1)) & 1) ? '1' : '0';
+        }
+        ++code;
+    }
+    return codes;
+}
+
+void CLIMWriter::write_frame(const std::vector<uint8_t>& frame, const std::vector<std::string>& codes,
+                             const Encoding encoding, BitWriter& writer) {
+    if (encoding == Encoding::HUFFMAN) {
+        writer.write_bits(0, 1);
+        for (uint8_t pixel : frame) {
+            writer.write_code(codes[pixel]);
+        }
+        writer.align_to_byte();
+        return;
+    }
+
+    // Runs (across rows), split to fit the count codes
+    const size_t max_run = encoding == Encoding::RLE_HUFFMAN ? MAX_HUFFMAN_RUN : frame.size();
+    std::vector<std::pair<uint8_t, size_t>> runs;
+    for (uint8_t pixel : frame) {
+        if (runs.empty() || runs.back().first != pixel || runs.back().second == max_run) {
+            runs.push_back(std::make_pair(pixel, 0));
+        }
+        ++runs.back().second;
+    }
+
+    writer.write_bits(1, 1);
+    if (encoding == Encoding::RLE) {
+        size_t longest = 0;
+        for (const std::pair<uint8_t, size_t>& run : runs) {
+            longest = std::max(longest, run.second);
+        }
+        size_t count_bits = std::max<size_t>(bit_length(longest - 1), 1);
+        writer.write_bits(0, 1);
+        writer.write_bits(count_bits - 1, 5);
+        for (const std::pair<uint8_t, size_t>& run : runs) {
+            writer.write_code(codes[run.first]);
+            writer.write_bits(run.second - 1, count_bits);
+        }
+    } else {
+        // Count codebook: number of codes, then value (count - 1), code length and code of each
+        std::map<size_t, size_t> count_frequencies;
+        for (const std::pair<uint8_t, size_t>& run : runs) {
+            ++count_frequencies[run.second - 1];
+        }
+        std::vector<size_t> values, frequencies;
+        for (const std::pair<const size_t, size_t>& entry : count_frequencies) {
+            values.push_back(entry.first);
+            frequencies.push_back(entry.second);
+        }
+        std::vector<std::string> count_codes = huffman_codes(frequencies, 16);
+        std::map<size_t, size_t> symbols;
+        for (size_t i = 0; i < values.size(); ++i) {
+            symbols[values[i]] = i;
+        }
+        size_t number_bits = bit_length(values.size());
+        size_t value_bits = std::max<size_t>(bit_length(values.back()), 1);
+        writer.write_bits(1, 1);
+        writer.write_bits(number_bits, 4);
+        writer.write_bits(values.size(), number_bits);
+        writer.write_bits(value_bits, 4);
+        for (size_t i = 0; i < values.size(); ++i) {
+            writer.write_bits(values[i], value_bits);
+            writer.write_bits(count_codes[i].size() - 1, 4);
+            writer.write_code(count_codes[i]);
+        }
+        for (const std::pair<uint8_t, size_t>& run : runs) {
+            writer.write_code(codes[run.first]);
+            writer.write_code(count_codes[symbols[run.second - 1]]);
+        }
+    }
+    writer.align_to_byte();
+}
+
+size_t CLIMWriter::bit_length(size_t value) {
+    size_t length = 0;
+    for (; value; value >>= 1) {
+        ++length;
+    }
+    return length;
+}
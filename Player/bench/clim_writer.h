@@ -0,0 +1,125 @@
+#ifndef CLIM_WRITER_H
+#define CLIM_WRITER_H
+
+#include <string>
+#include <vector>
+#include <cstdint>
+#include "color.h"
+
+/**
+ * @class BitWriter
+ * @brief Appends bits to a byte buffer, the first bit written being the most significant of its byte.
+ */
+class BitWriter {
+public:
+    /**
+     * @brief Writes the last bits of a value.
+     * @param value The value.
+     * @param n Number of bits to write (at most 64), the most significant first.
+     */
+    void write_bits(uint64_t value, size_t n);
+
+    /**
+     * @brief Writes a code given as a string of '0' and '1'.
+     * @param code The code.
+     */
+    void write_code(const std::string& code);
+
+    /**
+     * @brief Pads the last byte with zeros.
+     */
+    void align_to_byte();
+
+    /**
+     * @brief Gets the written bytes (the last one may be partial).
+     * @return The bytes.
+     */
+    const std::vector<uint8_t>& get_bytes() const {
+        return bytes;
+    }
+
+private:
+    std::vector<uint8_t> bytes;	///< Written bytes.
+    size_t bit_count = 0;		///< Number of written bits.
+};
+
+/**
+ * @class CLIMWriter
+ * @brief Writes synthetic CLIM files (standard format) from palette-indexed frames, for the benchmarks.
+ *
+ * Every cluster gets Huffman codes built from the frequencies of its colors (at most 8 bits), and all of its frames
+ * use the same encoding. The audio section is a placeholder, the file cannot be played with sound.
+ */
+class CLIMWriter {
+public:
+    /**
+     * @enum Encoding
+     * @brief Encodings of the frames.
+     */
+    enum class Encoding {
+        HUFFMAN,		///< A palette code per pixel.
+        RLE,			///< A palette code and a fixed-length count per run.
+        RLE_HUFFMAN		///< A palette code and a count code per run.
+    };
+
+    /**
+     * @brief Constructs a writer for a video.
+     * @param width Width of the frames in pixels.
+     * @param height Height of the frames in pixels.
+     * @param milliseconds_between_frames Frame duration in milliseconds.
+     */
+    CLIMWriter(const size_t width, const size_t height, const size_t milliseconds_between_frames = 40)
+        : width(width), height(height), milliseconds_between_frames(milliseconds_between_frames) {}
+
+    /**
+     * @brief Encodes a cluster of frames.
+     * @param colors The palette (1 to 256 colors).
+     * @param frames The frames, `width * height` palette indices each.
+     * @param encoding The encoding of the frames.
+     * @throws std::invalid_argument If the palette or a frame does not fit the video.
+     */
+    void add_cluster(const std::vector<Color>& colors, const std::vector<std::vector<uint8_t>>& frames,
+                     const Encoding encoding);
+
+    /**
+     * @brief Writes the file.
+     * @param file_path The path to the file.
+     * @throws std::runtime_error If there are no clusters or the file cannot be written.
+     */
+    void write(const std::string& file_path) const;
+
+    /**
+     * @brief Builds Huffman codes from the frequencies of symbols.
+     * @param frequencies The frequency of each symbol (symbols with a frequency of 0 get a code as well).
+     * @param max_length Longest allowed code length; codes of a fixed length are used if the optimal ones are longer.
+     * @return The code of each symbol, as a string of '0' and '1'.
+     */
+    static std::vector<std::string> huffman_codes(const std::vector<size_t>& frequencies, const size_t max_length);
+
+private:
+    static const size_t MAX_HUFFMAN_RUN = 4096;	///< Longest run of an RLE+Huffman frame (longer ones are split).
+
+    /**
+     * @brief Encodes a frame.
+     * @param frame The palette indices of the frame.
+     * @param codes The palette codes.
+     * @param encoding The encoding of the frame.
+     * @param writer Where to write the frame (byte-aligned at the end).
+     */
+    static void write_frame(const std::vector<uint8_t>& frame, const std::vector<std::string>& codes,
+                            const Encoding encoding, BitWriter& writer);
+
+    /**
+     * @brief Gets the number of bits needed to write a value.
+     * @param value The value.
+     * @return The bit length of the value (0 for 0).
+     */
+    static size_t bit_length(size_t value);
+
+    size_t width, height;					///< Dimensions of the frames in pixels.
+    size_t milliseconds_between_frames;		///< Frame duration in milliseconds.
+    std::vector<size_t> cluster_dimensions;	///< Number of frames of each cluster.
+    BitWriter clusters;						///< Encoded clusters.
+};
+
+#endif	// CLIM_WRITER_H
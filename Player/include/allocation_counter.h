@@ -0,0 +1,28 @@
+#ifndef ALLOCATION_COUNTER_H
+#define ALLOCATION_COUNTER_H
+
+#include <cstddef>
+
+/**
+ * @class AllocationCounter
+ * @brief A static utility class counting the heap allocations of the whole program.
+ *
+ * Counting replaces the global `operator new`, so it is only compiled when CLIM_DEBUG_ALLOCATIONS
+ * is defined (debug builds): otherwise the counter is disabled and always 0.
+ */
+class AllocationCounter {
+public:
+    /**
+     * @brief Checks whether allocations are counted in this build.
+     * @return True if CLIM_DEBUG_ALLOCATIONS is defined, false otherwise.
+     */
+    static bool enabled();
+
+    /**
+     * @brief Gets the number of heap allocations since the program start (from all threads).
+     * @return The number of allocations.
+     */
+    static size_t count();
+};
+
+#endif	// ALLOCATION_COUNTER_H
@@ -13,7 +13,10 @@ typedef unsigned char byte;
 
 /**
  * @class BinaryReader
- * @brief A utility class for reading binary files in chunks with optional overlap.
+ * @brief A utility class for reading binary files, memory-mapped or in chunks with optional overlap.
+ *
+ * When the file can be memory-mapped, the whole file is exposed as a single contiguous span
+ * and no data is copied. Otherwise the reader falls back to loading chunks through a file stream.
  */
 class BinaryReader {
 public:
@@ -27,8 +30,9 @@ public:
      * @param file_path Path to the binary file.
      * @param chunk_size Size of each chunk to read from the file.
      * @param overlap_size Overlap between consecutive chunks.
+     * @param memory_map Whether to try memory-mapping the file before falling back to chunks.
      */
-    BinaryReader(const std::string& file_path, size_t chunk_size, size_t overlap_size);
+    BinaryReader(const std::string& file_path, size_t chunk_size, size_t overlap_size, bool memory_map = true);
 
     /**
      * @brief Destructor for BinaryReader.
@@ -40,8 +44,9 @@ public:
      * @param file_path Path to the binary file.
      * @param chunk_size Size of each chunk to read from the file.
      * @param overlap_size Overlap between consecutive chunks.
+     * @param memory_map Whether to try memory-mapping the file before falling back to chunks.
      */
-    void setup(const std::string& file_path, size_t chunk_size, size_t overlap_size);
+    void setup(const std::string& file_path, size_t chunk_size, size_t overlap_size, bool memory_map = true);
 
     /**
      * @brief Gets a byte at the specified index in the file.
@@ -51,6 +56,30 @@ public:
      */
     uint8_t get_byte(size_t index);
 
+    /**
+     * @brief Gets the contiguous bytes available in memory starting from the specified index.
+     * @param index The index of the first byte of the span.
+     * @param available Output parameter to hold the number of bytes in the span (0 at the end of the file).
+     * @return A pointer to the byte at the specified index. When memory-mapped, it stays valid
+     *         for the lifetime of the reader; otherwise only until the next access to the reader.
+     */
+    const uint8_t* get_span(size_t index, size_t& available);
+
+    /**
+     * @brief Hints that a range of the file will be needed soon (no-op if not memory-mapped).
+     * @param index The index of the first byte of the range.
+     * @param length The length of the range in bytes.
+     */
+    void prefetch(size_t index, size_t length) const;
+
+    /**
+     * @brief Checks whether the file is memory-mapped.
+     * @return True if the whole file is available as a single span, false if read in chunks.
+     */
+    bool is_memory_mapped() const {
+        return mapped_data != nullptr;
+    }
+
     /**
      * @brief Gets the total size of the file in bytes.
      * @return The total file size.
@@ -64,6 +93,17 @@ private:
      */
     void load_chunk(size_t start_index);
 
+    /**
+     * @brief Memory-maps the whole file.
+     * @return True if the file has been mapped, false otherwise.
+     */
+    bool map_file();
+
+    /**
+     * @brief Releases the memory mapping, if any.
+     */
+    void unmap_file();
+
     std::string file_path;        	///< Path to the binary file.
     std::ifstream file_stream;    	///< Input file stream for reading binary data.
     std::vector<byte> buffer;     	///< Buffer holding the current chunk of data.
@@ -71,7 +111,7 @@ private:
     size_t chunk_size = 0;        	///< Size of each chunk to read.
     size_t overlap_size = 0;      	///< Overlap between consecutive chunks.
     size_t current_file_index = 0;	///< Current position in the file.
+    const uint8_t* mapped_data = nullptr;	///< Start of the memory-mapped file (nullptr if read in chunks).
 };
 
 #endif	// BINARY_READER_H
-
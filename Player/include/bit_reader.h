@@ -4,11 +4,15 @@
 #include <vector>
 #include <string>
 #include <cstdint>
+#include <stdexcept>
 #include "binary_reader.h"
 
 /**
  * @class BitReader
- * @brief A utility class for reading bits from a binary reader.
+ * @brief A utility class for reading bits (most significant first) from a binary reader.
+ *
+ * Bits are served from a 64-bit buffer, refilled with whole bytes taken from the contiguous
+ * span of the BinaryReader: once per span when the file is memory-mapped, once every few bytes otherwise.
  */
 class BitReader {
 public:
@@ -26,6 +30,75 @@ public:
      */
     uint64_t read_bits(size_t n);
 
+    /**
+     * @brief Returns the next bits without consuming them. Bits beyond the end of the data read as 0.
+     * @param n Number of bits to peek (at most MAX_PEEK_BITS).
+     * @return The bits peeked, the first one being the most significant.
+     */
+    inline uint64_t peek(size_t n) {
+        if (buffered_bits < n) {
+            refill();
+        }
+        return n ? bit_buffer >> (64 - n) : 0;
+    }
+
+    /**
+     * @brief Consumes the specified number of bits.
+     * @param n Number of bits to consume (at most MAX_PEEK_BITS).
+     * @throws std::out_of_range if this moves beyond the end of the data.
+     */
+    inline void consume(size_t n) {
+        if (buffered_bits < n) {
+            refill();
+            if (buffered_bits < n) {
+                throw std::out_of_range("Attempt to read beyond the end of the data.");
+            }
+        }
+        bit_buffer = (n < 64) ? bit_buffer << n : 0;
+        buffered_bits -= n;
+    }
+
+    /**
+     * @brief Makes the specified number of bits available to the buffered operations, unless the data ends before.
+     * @param n Number of bits needed (at most MAX_PEEK_BITS).
+     * @return True if the bits are buffered, false if the data ends before.
+     */
+    inline bool ensure(size_t n) {
+        if (buffered_bits < n) {
+            refill();
+        }
+        return buffered_bits >= n;
+    }
+
+    /**
+     * @brief Returns the next bits without consuming them, assuming they are buffered (see ensure).
+     * @param n Number of bits to peek (at most MAX_PEEK_BITS).
+     * @return The bits peeked, the first one being the most significant.
+     */
+    inline uint64_t peek_buffered(size_t n) const {
+        return n ? bit_buffer >> (64 - n) : 0;
+    }
+
+    /**
+     * @brief Consumes bits assumed to be buffered (see ensure), without any check.
+     * @param n Number of bits to consume (at most MAX_PEEK_BITS).
+     */
+    inline void consume_buffered(size_t n) {
+        bit_buffer <<= n;
+        buffered_bits -= n;
+    }
+
+    /**
+     * @brief Reads the specified number of bits as an integer, assuming they are buffered (see ensure).
+     * @param n Number of bits to read (at most MAX_PEEK_BITS).
+     * @return The bits read.
+     */
+    inline uint64_t read_bits_buffered(size_t n) {
+        uint64_t bits = peek_buffered(n);
+        consume_buffered(n);
+        return bits;
+    }
+
     /**
      * @brief Reads a single bit as a boolean.
      * @return The bit value as a boolean.
@@ -50,7 +123,7 @@ public:
      * @return The bit index.
      */
     inline size_t get_bit_index() const {
-        return bit_index;
+        return (8 - buffered_bits % 8) % 8;
     }
 
     /**
@@ -59,8 +132,8 @@ public:
      * @return The bit index.
      */
     inline size_t get_bit_index(size_t& _byte_index) const {
-        _byte_index = byte_index;
-        return bit_index;
+        _byte_index = (next_byte_index * 8 - buffered_bits) / 8;
+        return get_bit_index();
     }
 
     /**
@@ -69,22 +142,20 @@ public:
      */
     bool is_at_end() const;
 
+    static const size_t MAX_PEEK_BITS = 56;	///< Bits always available to peek() after a refill (unless at the end).
+
 private:
     /**
-     * @brief Increments the bit index and adjusts the byte index if necessary.
+     * @brief Tops up the bit buffer to at least MAX_PEEK_BITS bits (or up to the end of the data).
      */
-    inline void increment_bit_index() {
-        bit_index++;
-        if (bit_index == 8) {
-            bit_index = 0;
-            byte_index++;
-        }
-    }
+    void refill();
 
-    BinaryReader& data_reader;	///< Reference to the BinaryReader instance.
-    size_t byte_index = 0;		///< Current byte index.
-    size_t bit_index = 0;		///< Current bit index within the byte.
+    BinaryReader& data_reader;		///< Reference to the BinaryReader instance.
+    uint64_t bit_buffer = 0;		///< Buffered bits, left-aligned (the next bit is the most significant).
+    size_t buffered_bits = 0;		///< Number of valid bits in the buffer.
+    size_t next_byte_index = 0;		///< Index of the next byte to load into the buffer.
+    const uint8_t* span = nullptr;	///< Contiguous bytes starting at next_byte_index.
+    size_t span_available = 0;		///< Number of bytes in the span.
 };
 
 #endif	// BIT_READER_H
-
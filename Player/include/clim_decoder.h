@@ -6,6 +6,8 @@
 #include "binary_reader.h"
 #include "bit_reader.h"
 #include "cluster_decoder.h"
+#include "cluster_workers.h"
+#include "frame_pool.h"
 #include "audio_player.h"
 
 /**
@@ -46,14 +48,28 @@ public:
     ~CLIMDecoder();
 
     /**
-     * @brief Retrieves frames for the next cluster.
-     * @param frames Output parameter to hold the decoded frames.
-     * @return True if frames were successfully retrieved, false otherwise.
+     * @brief Decodes the next frame into a frame borrowed from a pool.
+     * Frames are decoded one at a time: only the palette of the current cluster and the position in the file are kept
+     * between calls, so the memory used does not depend on the length of the clusters.
+     * @param frame Output parameter to hold the decoded frame (its previous frame is released).
+     * @param pool The pool of frames to decode into, set up with the video dimensions.
+     * @return True if a frame was successfully decoded, false at the end of the video.
      */
-    bool get_next_cluster_frames(std::vector<Frame>& frames);
+    bool next_frame(FrameHandle& frame, FramePool& pool);
+
+    /**
+     * @brief Sets the number of threads decoding frames: beyond one, worker threads decode the upcoming clusters
+     * in parallel, while next_frame hands out their frames in order (and decodes the clusters left to it).
+     * Clusters are given to the workers as soon as their first byte is known, from the cluster index or from
+     * a scan of the cluster boundaries running ahead of decoding.
+     * @param threads Number of threads decoding frames, the one calling next_frame included (0 or 1: no workers).
+     * @param max_frames_ahead Number of frames decoded ahead by the workers at most (larger clusters are left to next_frame).
+     */
+    void set_decoding_threads(size_t threads, size_t max_frames_ahead);
 
     /**
      * @brief Sets the cluster for a specific frame index.
+     * Clusters already indexed are reached directly, the others by skipping from the last indexed one.
      * @param frame_index The frame index to set the cluster for.
      * @return True if successful, false otherwise.
      */
@@ -84,7 +100,15 @@ public:
 	}
 
     /**
-     * @brief Gets the index of the first frame in the current cluster.
+     * @brief Gets the number of frames in the largest cluster.
+     * @return The largest cluster dimension.
+     */
+    size_t get_max_cluster_frames() const {
+		return max_cluster_frames;
+	}
+
+    /**
+     * @brief Gets the index of the first frame in the current cluster (the one of the next frame to decode).
      * @return The index of the first frame.
      */
     size_t get_cluster_starting_frame() const {
@@ -115,10 +139,44 @@ private:
      */
     void extract_audio();
 
+    /**
+     * @brief Gives the workers the clusters following the current one, and scans ahead for their boundaries.
+     * @param pool The pool of frames to decode into.
+     */
+    void schedule_clusters(FramePool& pool);
+
+    /**
+     * @brief Records the first byte index of a cluster, if it is the next one missing from the index.
+     * @param cluster_index The index of the cluster.
+     * @param byte_index The first byte index of the cluster.
+     */
+    void index_cluster(size_t cluster_index, size_t byte_index);
+
+    /**
+     * @brief Computes the key identifying the current content of the CLIM file for its sidecar index.
+     * @param file_size Output parameter to hold the size of the file.
+     * @param modification_time Output parameter to hold the last modification time of the file.
+     * @param header_hash Output parameter to hold the hash of the headers (all bytes before the first cluster).
+     */
+    void compute_index_key(uint64_t& file_size, uint64_t& modification_time, uint64_t& header_hash);
+
+    /**
+     * @brief Loads the cluster index from the sidecar index file, if it exists and matches the CLIM file.
+     * @return True if the index has been loaded, false otherwise.
+     */
+    bool load_index();
+
+    /**
+     * @brief Saves the cluster index to the sidecar index file (failures are ignored: the index is just a cache).
+     */
+    void save_index();
+
     const std::string AUDIO_EXTENSION = "--audio" + AUDIO_FORMAT;	///< Audio file extension.
     std::string file_path;											///< Path to the CLIM file.
     std::string audio_extraction_folder;							///< Folder for extracted audio.
     std::string audio_extraxtion_filepath;							///< Path to the extracted audio file.
+    const std::string INDEX_EXTENSION = ".climidx";					///< Sidecar index file extension.
+    std::string index_filepath;										///< Path to the sidecar index file.
 
     BinaryReader encoded_file_reader;	///< Reader for the encoded file data.
     ClusterDecoder cluster_decoder;		///< Decoder for cluster data.
@@ -127,12 +185,24 @@ private:
     size_t next_byte_index;		///< Next byte to decode.
 
     std::vector<size_t> cluster_dimensions;	///< Dimensions of each cluster.
+    std::vector<size_t> cluster_starting_frames;	///< Index of the first frame of each cluster (prefix sums of the dimensions).
     size_t total_frames;					///< Total number of frames.
     size_t total_clusters;					///< Total number of clusters.
+    size_t max_cluster_frames;				///< Number of frames in the largest cluster.
 
+    std::vector<size_t> cluster_starting_bytes;	///< First byte index of each cluster found so far (in cluster order).
     size_t first_cluster_starting_byte_index;	///< First byte index of the first cluster.
+    size_t saved_indexed_clusters;				///< Number of clusters in the sidecar index file.
     size_t current_cluster_index;				///< Index of the current cluster.
     size_t cluster_starting_frame;				///< Index of the first frame in the current cluster.
+    size_t cluster_decoded_frames;				///< Number of frames of the current cluster decoded so far.
+    std::shared_ptr<Palette> cluster_colors;	///< Palette of the current cluster (null until its header is decoded).
+
+    ClusterWorkers workers;						///< Threads decoding the upcoming clusters (none by default).
+    size_t max_frames_ahead;					///< Number of frames the workers decode ahead at most.
+    size_t frames_ahead;						///< Number of frames of the clusters given to the workers and not taken back.
+    size_t next_submitted_cluster;				///< Index of the next cluster that may be given to the workers.
+    std::vector<FrameHandle> cluster_frames;	///< Frames of the current cluster decoded by the workers (empty otherwise).
 };
 
 #endif	// CLIM_DECODER_H
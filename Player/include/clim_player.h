@@ -2,14 +2,133 @@
 #define CLIM_PLAYER_H
 
 #include <vector>
+#include <array>
 #include <chrono>
+#include <thread>
+#include <atomic>
+#include <exception>
 #include "frame.h"
 #include "clim_decoder.h"
 #include "audio_player.h"
+#include "printable.h"
+#include "spsc_queue.h"
+#include "frame_pool.h"
+#include "allocation_counter.h"
+#include "output_sink.h"
+#include "frame_pacer.h"
+
+/**
+ * @enum LatePolicy
+ * @brief What the player does with frames it cannot display on time (e.g. on a slow terminal).
+ */
+enum class LatePolicy {
+    DROP,			///< Skip the frames whose display slot has passed: video stays locked to real time (and to audio).
+    SLOW_MOTION,	///< Display every frame, delaying the next ones: video slows down and drifts behind audio.
+    ADAPTIVE		///< Display late frames back to back to catch up on short delays, skip frames on longer ones.
+};
+
+/**
+ * @struct PlayerOptions
+ * @brief Settings of a CLIMPlayer.
+ */
+struct PlayerOptions {
+    size_t buffer_frames = 0;	///< Depth of the decoded frames queue in frames (0: derived from buffer_bytes).
+    size_t buffer_bytes = 0;	///< Depth of the decoded frames queue in bytes of pixels (0: 4 seconds of video).
+    RenderOptions render;		///< Settings of the frame renderer.
+    LatePolicy late_policy = LatePolicy::ADAPTIVE;	///< What to do with the frames that cannot be displayed on time.
+    size_t spin_us = 0;			///< Microseconds busy-waited before each frame start, for a more accurate pacing (0: sleep only).
+    bool adapt_output = true;	///< Whether to lighten the rendering when the output cannot keep up.
+    size_t decode_threads = 1;	///< Number of threads decoding frames (0: one per core, beyond 1: upcoming clusters decoded in parallel).
+};
+
+/**
+ * @struct OutputAdaptation
+ * @brief A change of the rendering settings, made because the output could not keep up.
+ */
+struct OutputAdaptation {
+    size_t frame = 0;				///< Index of the frame after which the change was made.
+    const char* change = "";		///< Description of the new settings.
+    double write_ms = 0;			///< Time spent writing a frame (moving average) when deciding, in milliseconds.
+    double output_rate = 0;			///< Bytes per second taken by the output since the start of playback when deciding.
+};
+
+/**
+ * @struct PlaybackStats
+ * @brief Counters collected during playback.
+ */
+struct PlaybackStats : public Printable {
+    size_t frames_rendered = 0;	///< Number of frames rendered.
+    size_t underruns = 0;		///< Number of frames the renderer had to wait for, as they were not decoded yet.
+    size_t frames_dropped = 0;	///< Number of frames skipped because their display slot had passed.
+    size_t frames_late = 0;		///< Number of frames not displayed within their display slot (the next frame was due before the end of their output).
+    size_t full_redraws = 0;	///< Number of frames redrawn in full (the others are deltas from the previous frame).
+    size_t bytes_written = 0;	///< Number of bytes written to the output for the frames (synchronized update markers excluded).
+    size_t write_calls = 0;		///< Number of write system calls made for the frames.
+    size_t max_frame_bytes = 0;	///< Largest number of bytes written for a single frame.
+    size_t allocations = 0;		///< Heap allocations while rendering (counted in debug builds only, see AllocationCounter).
+    JitterHistogram jitter;		///< Distribution of the frame start errors.
+
+    // Output backpressure
+    static const size_t MAX_ADAPTATIONS = 4;	///< Number of adaptations recorded at most (more than the possible changes).
+    size_t backlog_skips = 0;	///< Number of frames skipped (and counted as dropped) as the output held more than it drains in a frame time.
+    double write_ms = 0;		///< Time spent writing frames, in milliseconds.
+    double max_write_ms = 0;	///< Longest time spent writing a frame, in milliseconds.
+    size_t max_queued_bytes = 0;	///< Largest number of bytes found queued for the output before a frame.
+    double drain_rate = 0;		///< Bytes per second drained by the output while it stayed busy (moving average, 0 if it never was).
+    double playback_seconds = 0;	///< Duration of the playback, in seconds.
+    std::array<OutputAdaptation, MAX_ADAPTATIONS> adaptations;	///< Changes of the rendering settings, in order.
+    size_t adaptation_count = 0;	///< Number of changes of the rendering settings.
+    bool lightest_rendering = false;	///< Whether the output fell behind again once the rendering could not be lightened anymore.
+
+    /**
+     * @brief Implements the Printable interface for printing the counters.
+     * @param os The output stream to print to.
+     */
+    void print(std::ostream& os) const override {
+        os << "frames rendered: " << frames_rendered << "\n"
+           << "underruns: " << underruns << "\n"
+           << "frames dropped: " << frames_dropped << "\n"
+           << "frames late: " << frames_late << "\n"
+           << "full redraws: " << full_redraws << "\n"
+           << "bytes written: " << bytes_written << " (per frame: "
+           << (frames_rendered ? bytes_written / frames_rendered : 0) << " on average, " << max_frame_bytes << " at most)\n"
+           << "write calls: " << write_calls << " (per frame: "
+           << (frames_rendered ? static_cast<double>(write_calls) / frames_rendered : 0) << ")\n"
+           << jitter
+           << "output: " << write_ms << " ms spent writing (" << max_write_ms << " ms at most per frame), "
+           << (playback_seconds > 0 ? bytes_written / playback_seconds / 1000 : 0) << " kB/s, "
+           << max_queued_bytes << " bytes queued at most, " << backlog_skips << " frames skipped on backlog"
+           << (drain_rate > 0 ? ", drained at " + std::to_string(static_cast<size_t>(drain_rate / 1000)) + " kB/s when busy" : "")
+           << "\n";
+        for (size_t i = 0; i < adaptation_count; ++i) {
+            os << "rendering lightened after frame " << adaptations[i].frame << ": " << adaptations[i].change
+               << " (writes of " << adaptations[i].write_ms << " ms per frame, " << adaptations[i].output_rate / 1000
+               << " kB/s)\n";
+        }
+        if (lightest_rendering) {
+            os << "rendering could not be lightened further: frames were dropped instead\n";
+        }
+        if (AllocationCounter::enabled()) {
+            os << "allocations during playback: " << allocations << "\n";
+        }
+    }
+};
 
 /**
  * @class CLIMPlayer
  * @brief A class for playing CLIM video files with synchronized audio.
+ *
+ * Frames are decoded by a background thread and handed to the rendering loop through a
+ * bounded lock-free queue, so the rendering loop never decodes. Frames are decoded one at a time
+ * into a pool sized for the queue alone (whatever the length of the clusters), and return to it
+ * once displayed, so that steady-state playback does not allocate. With several decoding threads,
+ * worker threads decode the upcoming clusters in parallel, up to a queue depth of frames ahead.
+ *
+ * Each frame is due at its presentation time, counted from the start of playback. Frames that
+ * cannot be displayed on time are handled according to the LatePolicy of the player. When the
+ * output does not keep up (writes blocking for most of the frame time, or bytes left queued for
+ * the terminal), frames are skipped while the output holds the previous one and the rendering is
+ * lightened step by step: coalesced delta rendering, then 256 colors, then 16 colors.
  */
 class CLIMPlayer {
 public:
@@ -17,8 +136,10 @@ public:
      * @brief Constructor to initialize the player.
      * @param root_folder The root folder path.
      * @param file_path_from_root Path to the file relative to the root folder.
+     * @param options The player settings.
      */
-    CLIMPlayer(const std::string& root_folder, const std::string& file_path_from_root);
+    CLIMPlayer(const std::string& root_folder, const std::string& file_path_from_root,
+               const PlayerOptions& options = PlayerOptions());
 
     /**
      * @brief Destructor for CLIMPlayer.
@@ -26,41 +147,84 @@ public:
     ~CLIMPlayer();
 
     /**
-     * @brief Starts playback of frames and audio.
-     * @param outs The output stream for rendering.
+     * @brief Starts playback of frames and audio, until the end (or until a signal requests the exit).
+     * @param output The output the frames are written to.
      * @param loop Whether to loop playback.
      */
-    void play(std::ostream& outs, const bool loop = false);
+    void play(OutputSink& output, const bool loop = false);
+
+    /**
+     * @brief Gets the counters collected during playback.
+     * @return The playback statistics.
+     */
+    const PlaybackStats& get_stats() const {
+        return stats;
+    }
 
 private:
+    static const size_t CATCH_UP_LIMIT_MS = 100;	///< Delay up to which the adaptive policy catches up rather than dropping frames.
+    static const size_t WRITE_TIME_SMOOTHING = 8;	///< Number of frames the moving averages of the write time and drain rate roughly span.
+
     size_t destructor_fid;	///< Unique ID for cleanup functions.
 
     // Memory
     double fps;				///< Desired frames per second.
     size_t frame_time_ms;	///< Time in milliseconds between frames.
     size_t width, height;	///< Frame dimensions.
+    LatePolicy late_policy;	///< What to do with the frames that cannot be displayed on time.
+    FramePacer pacer;		///< Waits for the start of each frame.
+    bool adapt_output;		///< Whether to lighten the rendering when the output cannot keep up.
+    FramePool frame_pool;	///< Frames recycled between the decoding threads and the rendering loop (outlives the decoder and the queue).
     CLIMDecoder decoder;	///< Decoder for extracting frames.
 
     // Video
-    FrameRenderer renderer;				///< Renderer for drawing frames.
-    std::vector<Frame> frame_buffer;	///< Buffer for storing frames.
-    size_t buffer_threshold;			///< Threshold for fetching new frames.
+    FrameRenderer renderer;					///< Renderer for drawing frames.
+    SPSCQueue<FrameHandle> frame_queue;		///< Decoded frames, from the decoding thread to the rendering loop.
+    std::thread decoding_thread;			///< Thread decoding frames into the queue.
+    std::atomic<bool> stop_requested{false};	///< Atomic flag to signal the decoding thread to stop.
+    std::atomic<bool> decoding_finished{false};	///< Atomic flag set once the decoding thread pushed its last frame.
+    std::exception_ptr decoding_error;		///< Error thrown by the decoding thread (rethrown by the rendering loop).
+    PlaybackStats stats;					///< Counters collected during playback.
 
     // Audio
     AudioPlayer music;	///< Audio player for playing the soundtrack.
 
     /**
-     * @brief Fetches the next set of frames from the decoder.
-     * @return True if frames were successfully fetched, false otherwise.
+     * @brief Decodes frames into the queue until the end of the video (runs on the decoding thread).
+     */
+    void decode_frames();
+
+    /**
+     * @brief Starts the decoding thread.
+     */
+    void start_decoding();
+
+    /**
+     * @brief Stops the decoding thread and waits for it.
+     */
+    void stop_decoding();
+
+    /**
+     * @brief Takes the next decoded frame, waiting for the decoding thread if needed.
+     * @param frame Output parameter to hold the frame (its previous frame goes back to the pool).
+     * @return True if a frame has been taken, false at the end of the video.
      */
-    bool fetch_next_frames();
+    bool next_frame(FrameHandle& frame);
+
+    /**
+     * @brief Lightens the rendering settings by one step, to write fewer bytes per frame.
+     * @param frame_index Index of the last frame displayed.
+     * @param write_ms Time spent writing a frame (moving average), in milliseconds.
+     * @param output_rate Bytes per second taken by the output since the start of playback.
+     * @return False if the rendering cannot be lightened anymore.
+     */
+    bool lighten_rendering(const size_t frame_index, const double write_ms, const double output_rate);
 
     /**
      * @brief Starts the playback of CLIM content.
-     * @param outs The output stream for rendering.
+     * @param output The output the frames are written to.
      */
-    void play_clim(std::ostream& outs);
+    void play_clim(OutputSink& output);
 };
 
 #endif	// CLIM_PLAYER_H
-
@@ -2,12 +2,15 @@
 #define CLUSTER_DECODER_H
 
 #include <vector>
-#include <unordered_map>
 #include <string>
 #include "color.h"
-#include "huffman_codebook.h"
+#include "huffman_decoder.h"
+#include "multi_symbol_table.h"
+#include "run_table.h"
 #include "binary_reader.h"
+#include "bit_reader.h"
 #include "frame.h"
+#include "frame_pool.h"
 
 #ifndef BYTE_TYPE
 typedef unsigned char byte;
@@ -32,17 +35,24 @@ public:
     ClusterDecoder(const size_t width, const size_t height);
 
     /**
-     * @brief Decodes a cluster into a series of frames.
-     * @param binary_data_reader The binary reader for input data.
-     * @param index Reference to the current byte index.
-     * @param number_of_frames_in_cluster Number of frames in the cluster.
-     * @return A vector of decoded frames.
+     * @brief Decodes the palette header of a cluster, to be followed by its frames.
+     * @param data_reader The binary reader for input data.
+     * @param index Reference to the current byte index (the first byte of the cluster).
+     * @param colors Output parameter to hold the colors of the palette, shared by the frames of the cluster.
+     */
+    void decode_palette(BinaryReader& data_reader, size_t& index, Palette& colors);
+
+    /**
+     * @brief Decodes the next frame of the cluster whose palette was decoded last.
+     * @param data_reader The binary reader for input data.
+     * @param index Reference to the current byte index (the first byte of the frame).
+     * @param frame The frame to decode into, already sized to the frame dimensions.
+     * @throws std::runtime_error If the runs exceed the frame dimensions.
      */
-    std::vector<Frame> decode_cluster(BinaryReader& binary_data_reader,
-                                      size_t& index, size_t number_of_frames_in_cluster);
+    void decode_frame(BinaryReader& data_reader, size_t& index, Frame& frame);
 
     /**
-     * @brief Simulates decoding a cluster by updating the byte index.
+     * @brief Skips a cluster by updating the byte index, without storing its frames.
      * @param binary_data_reader The binary reader for input data.
      * @param index Reference to the current byte index.
      * @param number_of_frames_in_cluster Number of frames in the cluster.
@@ -53,23 +63,132 @@ public:
 private:
     size_t width, height;	///< Dimensions of the frames.
 
+    static const size_t RUN_TABLE_MIN_RUNS = static_cast<size_t>(1) << RunTable::TABLE_BITS;	///< Expected runs of a frame from which the run table is used (twice the break-even).
+
     /**
-     * @brief Decodes the palette header.
-     * @param data_reader The binary reader for input data.
-     * @param index Reference to the current byte index.
-     * @return A Huffman codebook for the color palette.
+     * @enum Encoding
+     * @brief Encoding of the pixels of a frame, given by its header.
+     */
+    enum class Encoding {
+        HUFFMAN,		///< A palette code per pixel.
+        RLE,			///< A palette code and a fixed-length run length per run.
+        RLE_HUFFMAN		///< A palette code and a Huffman-coded run length per run.
+    };
+
+    /**
+     * @struct FrameHeader
+     * @brief Holds the encoding method of a frame and its parameters.
+     */
+    struct FrameHeader {
+        Encoding encoding = Encoding::HUFFMAN;			///< Encoding of the pixels.
+        size_t rle_bit_length = 0;						///< Bits per run length (RLE only).
+        HuffmanDecoder<size_t> rle_huffman_codebook;	///< Huffman decoder for run lengths (RLE+Huffman only).
+    };
+
+    // Reused across clusters and frames, so that decoding does not allocate once their capacity is reached
+    HuffmanDecoder<Color> palette;	///< Huffman decoder for the palette of the current cluster (symbols are palette indices).
+    MultiSymbolTable palette_symbols;	///< Several palette codes per lookup, for Huffman-only frames (built on demand).
+    bool palette_symbols_built = false;	///< Whether `palette_symbols` matches the palette of the current cluster.
+    bool palette_symbols_used = false;	///< Whether `palette_symbols` resolves enough codes per lookup to be used.
+    RunTable run_table;				///< Palette code and run length per lookup, for RLE+Huffman frames (built per frame on demand).
+    FrameHeader header;				///< Header of the current frame.
+    Palette skipped_colors;			///< Colors of the clusters skipped by pass_cluster.
+
+    /**
+     * @brief Decodes the header of a frame into `header`.
+     * @param bit_reader The bit reader positioned at the start of the frame.
+     */
+    void decode_frame_header(BitReader& bit_reader);
+
+    /**
+     * @brief Decodes the next run of pixels sharing the same color (a single pixel if not RLE).
+     * @tparam ENCODING The encoding of the frame.
+     * @tparam BUFFERED Whether the bit reader is known to buffer the longest run (see BitReader::ensure).
+     * @param bit_reader The bit reader positioned at the start of the run.
+     * @param count Output parameter to hold the number of pixels in the run.
+     * @return The palette symbol of the run (its index in the palette).
+     * @throws std::runtime_error If a code is not found.
+     */
+    template <Encoding ENCODING, bool BUFFERED>
+    size_t decode_run(BitReader& bit_reader, size_t& count);
+
+    /**
+     * @brief Decodes the pixels of a frame, with a loop specialized for its encoding.
+     * While the bit buffer holds several of the longest runs, these are decoded without any check for more bits.
+     * @tparam ENCODING The encoding of the frame.
+     * @tparam FUSED Whether the runs are first looked up in `run_table` (RLE+Huffman only, see use_run_table).
+     * @param bit_reader The bit reader positioned after the frame header.
+     * @param frame The frame to decode into.
+     * @throws std::runtime_error If a code is not found or the runs exceed the frame dimensions.
+     */
+    template <Encoding ENCODING, bool FUSED = false>
+    void decode_pixels(BitReader& bit_reader, Frame& frame);
+
+    /**
+     * @brief Checks whether the multi-symbol table pays off for the Huffman-only frames of the current cluster,
+     * building it the first time: frames must be as large as the table, and codes short enough.
+     * @return True if decode_huffman_pixels should be used.
+     */
+    bool use_palette_symbols();
+
+    /**
+     * @brief Decodes the pixels of a Huffman-only frame, resolving several palette codes per table lookup.
+     * @param bit_reader The bit reader positioned after the frame header.
+     * @param frame The frame to decode into.
+     * @throws std::runtime_error If a code is not found.
+     */
+    void decode_huffman_pixels(BitReader& bit_reader, Frame& frame);
+
+    /**
+     * @brief Checks whether the run table pays off for the current RLE+Huffman frame, building it if so:
+     * the expected number of runs (from the code lengths) must be large compared to the table size.
+     * @return True if decode_pixels should look the runs up in `run_table`.
+     */
+    bool use_run_table();
+
+    /**
+     * @brief Gets the length of the longest run of the current frame (palette code and run length).
+     * @return The length in bits.
+     */
+    size_t max_run_bits() const;
+
+    /**
+     * @brief Walks through the pixels of a frame without storing them, in the same batches as decode_pixels.
+     * @tparam ENCODING The encoding of the frame.
+     * @tparam FUSED Whether the runs are first looked up in `run_table` (RLE+Huffman only, see use_run_table).
+     * @param bit_reader The bit reader positioned after the frame header.
+     * @throws std::runtime_error If a code is not found or the runs exceed the frame dimensions.
+     */
+    template <Encoding ENCODING, bool FUSED = false>
+    void pass_pixels(BitReader& bit_reader);
+
+    /**
+     * @brief Walks through the pixels of a Huffman-only frame without storing them, several palette codes per lookup.
+     * @param bit_reader The bit reader positioned after the frame header.
+     * @throws std::runtime_error If a code is not found.
+     */
+    void pass_huffman_pixels(BitReader& bit_reader);
+
+    /**
+     * @brief Throws the error for a code missing from the palette (or from the run lengths, if `count` is true).
+     * @param count Whether the code is a run length.
+     * @throws std::runtime_error Always.
+     */
+    void throw_invalid_code(bool count) const;
+
+    /**
+     * @brief Throws the error for a run longer than the pixels left in the frame.
+     * @param count The length of the run.
+     * @throws std::runtime_error Always.
      */
-    HuffmanCodebook<Color> decode_palette(BinaryReader& data_reader, size_t& index);
+    void throw_run_overflow(size_t count) const;
 
     /**
-     * @brief Decodes a single frame.
+     * @brief Skips a single frame without storing its pixels.
      * @param data_reader The binary reader for input data.
      * @param index Reference to the current byte index.
-     * @param palette The Huffman codebook for the palette.
-     * @return A decoded frame.
      */
-    FlatFrame decode_frame(BinaryReader& data_reader, size_t& index,
-                           const HuffmanCodebook<Color>& palette);
+    void pass_frame(BinaryReader& data_reader, size_t& index);
 };
 
 #endif	// CLUSTER_DECODER_H
@@ -0,0 +1,196 @@
+#ifndef CLUSTER_WORKERS_H
+#define CLUSTER_WORKERS_H
+
+#include <vector>
+#include <string>
+#include <memory>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
+#include <exception>
+#include "binary_reader.h"
+#include "cluster_decoder.h"
+#include "frame_pool.h"
+
+/**
+ * @class ClusterWorkers
+ * @brief A pool of threads decoding upcoming clusters in parallel, handed back in cluster order.
+ *
+ * Clusters are byte-aligned and carry their own palette, so any cluster whose first byte is known
+ * can be decoded on its own. Each worker has its own reader of the file and its own ClusterDecoder.
+ * Decoding jobs are taken back in the order they were submitted. A scan of the cluster boundaries
+ * (walking the codes without storing pixels) can run ahead, to find where the next clusters start.
+ *
+ * Jobs are submitted and taken back by a single thread. Their slots and frame lists are allocated
+ * by start(), so that steady-state decoding does not allocate.
+ */
+class ClusterWorkers {
+public:
+    /**
+     * @brief Default constructor for a pool without threads.
+     */
+    ClusterWorkers() = default;
+
+    ClusterWorkers(const ClusterWorkers&) = delete;
+    ClusterWorkers& operator=(const ClusterWorkers&) = delete;
+
+    /**
+     * @brief Destructor stopping the threads.
+     */
+    ~ClusterWorkers() {
+        stop();
+    }
+
+    /**
+     * @brief Starts the worker threads (after stopping the previous ones).
+     * @param file_path Path to the CLIM file.
+     * @param width Width of the frames.
+     * @param height Height of the frames.
+     * @param cluster_dimensions Number of frames of each cluster (must outlive the workers).
+     * @param threads Number of worker threads.
+     * @param max_cluster_frames Number of frames of the largest cluster that can be submitted.
+     */
+    void start(const std::string& file_path, size_t width, size_t height,
+               const std::vector<size_t>& cluster_dimensions, size_t threads, size_t max_cluster_frames);
+
+    /**
+     * @brief Stops the worker threads, dropping the jobs not taken back.
+     */
+    void stop();
+
+    /**
+     * @brief Checks whether the worker threads are running.
+     * @return True if jobs can be submitted.
+     */
+    bool running() const {
+        return !workers.empty();
+    }
+
+    /**
+     * @brief Checks whether a decoding job can be submitted (a slot is free).
+     * @return True if submit can be called.
+     */
+    bool can_submit() const;
+
+    /**
+     * @brief Queues the decoding of a cluster, after the clusters already submitted.
+     * @param cluster_index The index of the cluster.
+     * @param byte_index The first byte index of the cluster.
+     * @param colors The palette to fill with the colors of the cluster, shared by its frames.
+     * @param pool The pool of frames to decode into.
+     */
+    void submit(size_t cluster_index, size_t byte_index, const std::shared_ptr<Palette>& colors, FramePool& pool);
+
+    /**
+     * @brief Checks whether a cluster is the next one to be taken back.
+     * @param cluster_index The index of the cluster.
+     * @return True if the oldest job not taken back decodes this cluster.
+     */
+    bool is_next(size_t cluster_index) const;
+
+    /**
+     * @brief Takes back the oldest job, waiting for it to be decoded.
+     * @param frames Output parameter to hold the decoded frames (its previous handles are released).
+     * @param end_byte_index Output parameter to hold the byte index following the cluster.
+     * @throws The error thrown while decoding the cluster, if any.
+     */
+    void take(std::vector<FrameHandle>& frames, size_t& end_byte_index);
+
+    /**
+     * @brief Starts scanning the cluster boundaries, unless a scan is already running.
+     * @param cluster_index The index of the first cluster to walk through.
+     * @param byte_index The first byte index of that cluster.
+     * @param end_cluster_index The index of the last cluster whose first byte is wanted.
+     */
+    void scan(size_t cluster_index, size_t byte_index, size_t end_cluster_index);
+
+    /**
+     * @brief Gets the first byte index of a cluster found by the last scan.
+     * @param cluster_index The index of the cluster.
+     * @param byte_index Output parameter to hold the first byte index of the cluster.
+     * @return True if the scan went past the start of the cluster, false otherwise.
+     */
+    bool scanned(size_t cluster_index, size_t& byte_index) const;
+
+    /**
+     * @brief Drops all the jobs (and the scan), waiting for the running ones to stop.
+     */
+    void cancel();
+
+private:
+    /**
+     * @enum JobState
+     * @brief Progress of a job slot.
+     */
+    enum class JobState {
+        FREE,		///< Not in use.
+        PENDING,	///< Waiting for a worker.
+        RUNNING,	///< Being decoded by a worker.
+        DONE		///< Decoded, waiting to be taken back.
+    };
+
+    /**
+     * @struct Job
+     * @brief The decoding of a cluster.
+     */
+    struct Job {
+        JobState state = JobState::FREE;	///< Progress of the job.
+        size_t cluster_index = 0;			///< Index of the cluster.
+        size_t byte_index = 0;				///< First byte index of the cluster, then the byte index following it.
+        std::shared_ptr<Palette> colors;	///< Palette of the cluster.
+        FramePool* pool = nullptr;			///< Pool of frames to decode into.
+        std::vector<FrameHandle> frames;	///< Decoded frames (capacity kept for the largest cluster).
+        std::exception_ptr error;			///< Error thrown while decoding, if any.
+    };
+
+    /**
+     * @struct Worker
+     * @brief What a worker thread decodes with.
+     */
+    struct Worker {
+        BinaryReader reader;		///< Reader of the file (not shared, as chunked readers are not thread-safe).
+        ClusterDecoder decoder;		///< Decoder (its Huffman tables are reused from a cluster to the next).
+        std::thread thread;			///< The worker thread.
+    };
+
+    /**
+     * @brief Runs the jobs and the scans of a worker until the pool stops.
+     * @param worker The worker.
+     */
+    void work(Worker& worker);
+
+    /**
+     * @brief Decodes the cluster of a job (called without the lock).
+     * @param worker The worker.
+     * @param job The job.
+     */
+    void decode(Worker& worker, Job& job);
+
+    /**
+     * @brief Walks through the clusters of the scan, publishing their boundaries (called without the lock).
+     * @param worker The worker.
+     */
+    void run_scan(Worker& worker);
+
+    std::vector<std::unique_ptr<Worker>> workers;		///< The workers (empty if not running).
+    const std::vector<size_t>* cluster_dimensions = nullptr;	///< Number of frames of each cluster.
+    std::vector<Job> jobs;			///< Ring of job slots, in submission order.
+    size_t first_job = 0;			///< Slot of the oldest job not taken back.
+    size_t job_count = 0;			///< Number of jobs not taken back.
+
+    JobState scan_state = JobState::FREE;	///< Progress of the scan (never DONE: FREE once finished).
+    size_t scan_cluster_index = 0;			///< Index of the cluster the scan starts from.
+    size_t scan_byte_index = 0;				///< First byte index of that cluster.
+    size_t scan_end_cluster_index = 0;		///< Index of the last cluster whose first byte is wanted.
+    std::vector<size_t> scanned_byte_indices;	///< First byte index of the clusters found by the scan (by cluster index).
+    size_t scanned_cluster_index = 0;		///< Index of the last cluster found by the scan.
+
+    bool stopping = false;					///< Whether the workers must return.
+    std::atomic<bool> cancelling{false};	///< Whether running jobs must stop early.
+    mutable std::mutex mutex;				///< Protects the jobs and the scan.
+    std::condition_variable work_available;	///< Signaled when a job or a scan is submitted, or when stopping.
+    std::condition_variable work_finished;	///< Signaled when a job or a scan ends.
+};
+
+#endif	// CLUSTER_WORKERS_H
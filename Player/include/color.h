@@ -1,18 +1,21 @@
 #ifndef COLOR_H
 #define COLOR_H
 
-#include "printable.h"
+#include <ostream>
+#include <type_traits>
 
 #ifndef BYTE_TYPE
 typedef unsigned char byte;
 #endif
 
 /**
- * @class Color
+ * @struct Color
  * @brief Represents a color using RGB components.
+ *
+ * A packed, trivially copyable value (3 bytes, no virtual functions): frames of colors can be
+ * filled, copied and compared with plain memory operations.
  */
-class Color : public Printable {
-public:
+struct Color {
     byte r, g, b;	///< Red, green, and blue components of the color.
 
     /**
@@ -34,13 +37,27 @@ public:
     }
 
     /**
-     * @brief Implements the Printable interface for printing the color.
-     * @param os The output stream to print to.
+     * @brief Checks for inequality between two colors.
+     * @param other The other color to compare with.
+     * @return True if the colors differ, false otherwise.
      */
-    void print(std::ostream& os) const override {
-        os << "(" << static_cast<int>(r) << ", " << static_cast<int>(g) << ", " << static_cast<int>(b) << ")";
+    bool operator!=(const Color& other) const {
+        return !(*this == other);
     }
 };
 
-#endif	// COLOR_H
+static_assert(sizeof(Color) == 3, "Color must be packed in 3 bytes");
+static_assert(std::is_trivially_copyable<Color>::value, "Color must be trivially copyable");
+
+/**
+ * @brief Overloads the stream insertion operator for printing a color.
+ * @param os The output stream.
+ * @param color The color to print.
+ * @return The output stream.
+ */
+inline std::ostream& operator<<(std::ostream& os, const Color& color) {
+    os << "(" << static_cast<int>(color.r) << ", " << static_cast<int>(color.g) << ", " << static_cast<int>(color.b) << ")";
+    return os;
+}
 
+#endif	// COLOR_H
@@ -5,6 +5,7 @@
 #include <vector>
 #include <unordered_map>
 #include <functional>
+#include <atomic>
 
 #ifdef _WIN32
 #include <windows.h>
@@ -22,6 +23,10 @@ using cleanup_function_t = std::function<void()>;
 /**
  * @class ExitHandler
  * @brief A static utility class to handle cleanup operations at program termination.
+ *
+ * Interrupt and termination signals (Ctrl+C) only request the exit: the program polls exit_requested() and
+ * returns normally, so that its destructors run outside of the signal handler. A second signal terminates at once.
+ * Closing the Windows console executes the cleanup functions, as the process is killed right after.
  */
 class ExitHandler {
 public:
@@ -38,11 +43,20 @@ public:
      */
     static void remove_cleanup_function(size_t id);
 
+    /**
+     * @brief Checks whether a signal (or Ctrl+C) asked the program to exit.
+     * @return True once the exit has been requested.
+     */
+    static bool exit_requested() {
+        return exit_request.load(std::memory_order_relaxed);
+    }
+
 private:
     static bool initialized;													///< Whether the class has been initialized.
     static std::unordered_map<size_t, cleanup_function_t> cleanup_functions;	///< Registered cleanup functions.
     static size_t current_id;													///< Counter for assigning unique IDs.
     static bool is_cleaning_up;													///< Whether cleanup is in progress.
+    static std::atomic<bool> exit_request;										///< Whether a signal asked to exit (set by the handlers).
 
     /**
      * @brief Initializes the ExitHandler.
@@ -52,7 +66,7 @@ private:
 #ifdef _WIN32
     static BOOL WINAPI onCloseHandler(DWORD event);	///< Handles Windows console events.
 #else
-    static void onSignal(int signal);				///< Handles Unix signals.
+    static void onSignal(int signal);				///< Handles Unix signals (only async-signal-safe calls).
 #endif
 
     /**
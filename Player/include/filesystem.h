@@ -31,6 +31,14 @@ namespace std {
          */
         bool delete_file(const std::string& file_path);
 
+        /**
+         * @brief Gets the last modification time of a file.
+         * @param file_path The path to the file.
+         * @return The last modification time (in nanoseconds since the epoch, at the resolution of the file system),
+         *         or -1 if unavailable.
+         */
+        long long last_write_time(const std::string& file_path);
+
         /**
          * @brief Creates directories recursively.
          * @param path The path to the directory.
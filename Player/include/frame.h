@@ -3,35 +3,127 @@
 
 #include <string>
 #include <vector>
+#include <array>
+#include <memory>
+#include <cstdint>
+#include <cstring>
 #include "color.h"
+#include "simd_kernels.h"
 
 /**
- * @struct Frame
- * @brief Represents a grid of colored pixels.
+ * @struct Palette
+ * @brief The colors of a cluster, indexed by the pixels of its frames.
  */
-struct Frame {
-    std::vector<std::vector<Color>> pixels_grid; ///< 2D grid of pixels.
+struct Palette {
+    static const size_t MAX_COLORS = 256;	///< A cluster has at most 256 colors (indexed by a byte).
+
+    std::array<Color, MAX_COLORS> colors;	///< Colors of the palette (only the first `size` ones are used).
+    size_t size = 0;						///< Number of colors in the palette.
+    uint64_t id = 0;						///< Identifies the content: changed every time the palette is reused for another cluster.
 };
 
 /**
- * @struct FlatFrame
- * @brief Represents a linear array of pixels.
+ * @struct Frame
+ * @brief Represents a grid of palette-indexed pixels, stored row after row in a single contiguous buffer.
+ *
+ * Each pixel is the index of its color in the palette shared by the frames of a cluster:
+ * colors are resolved only when the frame is rendered.
  */
-struct FlatFrame {
-    std::vector<Color> pixels;	///< 1D array of pixels.
+struct Frame {
+    size_t width = 0;			///< Width of the frame in pixels.
+    size_t height = 0;			///< Height of the frame in pixels.
+    size_t stride = 0;			///< Distance in pixels between the starts of two consecutive rows (at least `width`).
+    std::vector<uint8_t> pixels;	///< Palette indices buffer: row `y` starts at `y * stride`.
+    std::shared_ptr<const Palette> palette;	///< Palette of the cluster of the frame.
 
     /**
-     * @brief Converts a FlatFrame into a Frame.
-     * @param width Width of the target frame.
-     * @param height Height of the target frame.
-     * @return A 2D grid representation of the pixels.
+     * @brief Default constructor for an empty frame.
      */
-    Frame to_frame(const size_t width, const size_t height) const;
+    Frame() {}
+
+    /**
+     * @brief Constructor allocating a frame of the given dimensions (rows are not padded).
+     * @param width Width of the frame.
+     * @param height Height of the frame.
+     */
+    Frame(const size_t width, const size_t height)
+        : width(width), height(height), stride(width), pixels(width * height) {}
+
+    /**
+     * @brief Gets a row of the frame.
+     * @param y The index of the row.
+     * @return A pointer to the first of the `width` palette indices of the row.
+     */
+    uint8_t* row(const size_t y) {
+        return pixels.data() + y * stride;
+    }
+
+    /**
+     * @brief Gets a row of the frame.
+     * @param y The index of the row.
+     * @return A pointer to the first of the `width` palette indices of the row.
+     */
+    const uint8_t* row(const size_t y) const {
+        return pixels.data() + y * stride;
+    }
+
+    /**
+     * @brief Resolves the color of a pixel through the palette.
+     * @param x The column of the pixel.
+     * @param y The row of the pixel.
+     * @return The color of the pixel.
+     */
+    const Color& color(const size_t x, const size_t y) const {
+        return palette->colors[row(y)[x]];
+    }
+};
+
+/**
+ * @enum EscapeMode
+ * @brief When the renderer emits the color escape codes of a cell.
+ */
+enum class EscapeMode {
+    PER_PIXEL,	///< Before every cell.
+    PER_RUN		///< Only when a color changes along the row: a run of identical cells shares the escape codes.
+};
+
+/**
+ * @enum RenderStrategy
+ * @brief How pixels are drawn with terminal cells.
+ */
+enum class RenderStrategy {
+    SPACES,		///< A pixel per cell: a space with the pixel as background color.
+    HALF_BLOCKS	///< Two vertically adjacent pixels per cell: an upper half block with the top pixel as foreground color and the bottom one as background color.
+};
+
+/**
+ * @enum ColorMode
+ * @brief Colors the terminal can display, selecting the escape codes of the output.
+ */
+enum class ColorMode {
+    TRUE_COLOR,	///< 24-bit colors ("\033[48;2;R;G;Bm"): the exact palette colors.
+    COLORS_256,	///< xterm 256 colors ("\033[48;5;Nm"): the nearest color of the 6x6x6 cube or of the gray ramp.
+    COLORS_16	///< ANSI 16 colors ("\033[4Nm", "\033[10Nm"): the nearest standard color.
+};
+
+/**
+ * @struct RenderOptions
+ * @brief Settings of a FrameRenderer.
+ */
+struct RenderOptions {
+    RenderStrategy strategy = RenderStrategy::SPACES;	///< How pixels are drawn with terminal cells.
+    EscapeMode escape_mode = EscapeMode::PER_RUN;	///< When to emit the color escape codes.
+    ColorMode color_mode = ColorMode::TRUE_COLOR;	///< Colors the terminal can display.
+    double redraw_threshold = 0.5;	///< Fraction of changed cells above which a frame is redrawn in full (0: always, no delta rendering).
 };
 
 /**
  * @class FrameRenderer
  * @brief Handles the rendering of frames into a displayable format.
+ *
+ * Unless disabled, frames are rendered as a delta from the previous one: only the spans of cells
+ * whose colors changed are written, each after a cursor positioning sequence. The first frame,
+ * the frames after reset() and the frames changing too many cells are redrawn in full.
  */
 class FrameRenderer {
 public:
@@ -44,28 +136,249 @@ public:
      * @brief Parameterized constructor.
      * @param width Width of the frame.
      * @param height Height of the frame.
+     * @param options The rendering settings.
+     */
+    FrameRenderer(const size_t width, const size_t height, const RenderOptions& options = RenderOptions());
+
+    /**
+     * @brief Guesses the colors the terminal can display from the environment: `COLORTERM` announcing 24-bit
+     * colors, then `TERM` announcing 256 colors. Other terminals get 16 colors, unless `TERM` is not set (e.g. the
+     * Windows console), which gets 24-bit colors.
+     * @return The color mode to render with.
      */
-    FrameRenderer(const size_t width, const size_t height);
+    static ColorMode detect_color_mode();
 
     /**
-     * @brief Renders a frame as a colored string.
+     * @brief Renders a frame as a colored string, starting by moving the cursor to the top-left position.
+     * The palette colors are converted once per palette to the color mode, then their escape codes are copied for
+     * every cell.
      * @param frame The frame to render.
-     * @return A string representation of the frame.
+     * @return A string representation of the frame, valid until the next rendering (its buffer is reused).
      */
-    std::string render_frame(const Frame& frame);
+    const std::string& render_frame(const Frame& frame);
 
     /**
-     * @brief Renders a flat frame as a colored string.
-     * @param flat_frame The flat frame to render.
-     * @return A string representation of the flat frame.
+     * @brief Forgets the previous frame, so that the next one is redrawn in full (e.g. when the screen is not the
+     * last rendered frame anymore).
      */
-    std::string render_flat_frame(const FlatFrame& flat_frame) {
-        return render_frame(flat_frame.to_frame(width, height));
+    void reset() {
+        has_previous = false;
     }
 
+    /**
+     * @brief Checks whether the last frame rendered has been redrawn in full.
+     * @return True for a full redraw, false for a delta from the previous frame.
+     */
+    bool last_frame_full() const {
+        return last_full;
+    }
+
+    /**
+     * @brief Gets the rendering settings.
+     * @return The rendering settings.
+     */
+    const RenderOptions& get_options() const {
+        return options;
+    }
+
+    /**
+     * @brief Changes the rendering settings between two frames (the next frame is redrawn in full).
+     * @param options The new rendering settings.
+     */
+    void set_options(const RenderOptions& options);
+
 private:
+    typedef SimdKernels::Escape Escape;	///< The escape code selecting a color, copied whole.
+
+    /**
+     * @struct ColorState
+     * @brief Colors currently selected in the terminal, as terminal colors (or DEFAULT_COLOR).
+     */
+    struct ColorState {
+        int foreground;	///< Foreground color.
+        int background;	///< Background color.
+    };
+
+    static const char CURSOR_HOME[];			///< Output bytes moving the cursor to the top-left position.
+    static const size_t CURSOR_HOME_LENGTH = 3;	///< Length of CURSOR_HOME.
+    static const char ROW_END[];				///< Output bytes at the end of every row.
+    static const size_t ROW_END_LENGTH = 5;		///< Length of ROW_END.
+    static const char DEFAULT_BACKGROUND[];		///< Output bytes selecting the default background color.
+    static const char UPPER_HALF_BLOCK[];		///< UTF-8 bytes of the upper half block character.
+    static const char FULL_BLOCK[];				///< UTF-8 bytes of the full block character.
+    static const size_t BLOCK_LENGTH = 3;		///< Length of the UTF-8 bytes of a block character.
+    static const size_t MAX_CURSOR_MOVE_LENGTH = 14;	///< Longest cursor positioning sequence ("\033[65535;65535H").
+    static const size_t MERGED_GAP = 8;			///< Unchanged cells rewritten rather than skipped (a cursor move costs more).
+    static const int DEFAULT_COLOR = -1;		///< Color index of the default terminal colors (after a reset).
+
     size_t width, height;	///< Dimensions of the frame.
+    RenderOptions options;	///< The rendering settings.
+    std::string output;		///< Buffer of the last rendered frame (its capacity is kept between frames).
+    std::array<Escape, Palette::MAX_COLORS> background_escapes;	///< Background escape code of each terminal color.
+    std::array<Escape, Palette::MAX_COLORS> foreground_escapes;	///< Foreground escape code of each terminal color.
+    std::array<uint8_t, Palette::MAX_COLORS> terminal_colors;	///< Terminal color (index of its escape codes) of each color of the current palette.
+    const Palette* escapes_palette = nullptr;	///< Palette the terminal colors have been computed for.
+    uint64_t escapes_palette_id = 0;			///< Identifier of the content of `escapes_palette` when computed.
+
+    // Delta rendering
+    std::vector<uint8_t> previous_pixels;	///< Palette indices of the previous frame.
+    Palette previous_palette;				///< Copy of the palette of the previous frame.
+    const Palette* previous_palette_source = nullptr;	///< Palette the copy has been taken from.
+    std::vector<uint8_t> cell_changes;		///< Whether each cell of the frame being rendered changed (1) or not (0).
+    bool same_palette = false;				///< Whether the frame being rendered uses the palette of the previous one.
+    bool has_previous = false;				///< Whether the previous frame is what the screen shows.
+    bool last_full = true;					///< Whether the last frame has been redrawn in full.
+
+    /**
+     * @brief Converts every color of a palette to a terminal color: in 24-bit colors, the terminal color of a palette
+     * index is the index itself and its escape codes are formatted; otherwise, it is the nearest fixed terminal color.
+     * @param palette The palette.
+     */
+    void build_escapes(const Palette& palette);
+
+    /**
+     * @brief Formats the escape codes of the fixed terminal colors of the 256 and 16 colors modes.
+     */
+    void build_fixed_escapes();
+
+    /**
+     * @brief Finds the xterm 256 colors index nearest to a color, in the 6x6x6 cube (16-231) or in the gray ramp (232-255).
+     * @param color The color.
+     * @return The index.
+     */
+    static uint8_t nearest_256_color(const Color& color);
+
+    /**
+     * @brief Finds the ANSI color nearest to a color, with the xterm default values of the 16 colors.
+     * @param color The color.
+     * @return The index (0-7 normal, 8-15 bright).
+     */
+    static uint8_t nearest_16_color(const Color& color);
+
+    /**
+     * @brief Formats an escape code selecting a color: "\033[", an introducer, the numbers separated by ';', then 'm'.
+     * @param escape The escape code to format.
+     * @param introducer The parameters before the numbers (e.g. "48;2;").
+     * @param numbers The numbers.
+     * @param count The number of numbers.
+     */
+    static void format_escape(Escape& escape, const char* introducer, const size_t* numbers, const size_t count);
+
+    /**
+     * @brief Gets the number of pixel rows drawn by a row of cells.
+     * @return 2 for half blocks, 1 otherwise.
+     */
+    size_t pixel_rows_per_cell() const {
+        return options.strategy == RenderStrategy::HALF_BLOCKS ? 2 : 1;
+    }
+
+    /**
+     * @brief Computes the size of the output buffer needed to render any frame.
+     * @param width Width of the frame.
+     * @param height Height of the frame.
+     * @return The size in bytes.
+     */
+    size_t max_output_size(const size_t width, const size_t height) const;
+
+    /**
+     * @brief Checks whether a pixel changed since the previous frame.
+     * Within a palette, pixels are compared by index: a palette repeating a color may cause needless rewrites only.
+     * @param frame The frame being rendered.
+     * @param pixel The palette index of the pixel in the frame.
+     * @param previous_pixel The palette index of the pixel in the previous frame.
+     * @return True if the pixel has to be rewritten.
+     */
+    bool pixel_changed(const Frame& frame, const uint8_t pixel, const uint8_t previous_pixel) const {
+        return same_palette ? pixel != previous_pixel
+                            : frame.palette->colors[pixel] != previous_palette.colors[previous_pixel];
+    }
+
+    /**
+     * @brief Marks in `cell_changes` the cells of a row of cells that changed since the previous frame.
+     * @param frame The frame being rendered.
+     * @param cell_row The index of the row of cells.
+     * @return The number of cells that have to be rewritten.
+     */
+    size_t mark_changed_cells(const Frame& frame, const size_t cell_row);
+
+    /**
+     * @brief Writes every row of cells of a frame.
+     * @param frame The frame.
+     * @param destination Where to write.
+     * @return The end of the written bytes.
+     */
+    char* write_rows(const Frame& frame, char* destination) const;
+
+    /**
+     * @brief Writes the spans of cells that changed since the previous frame (as marked in `cell_changes`).
+     * @param frame The frame.
+     * @param destination Where to write.
+     * @return The end of the written bytes.
+     */
+    char* write_changes(const Frame& frame, char* destination) const;
+
+    /**
+     * @brief Writes consecutive cells of a row, with the current rendering strategy.
+     * @param frame The frame.
+     * @param cell_row The row of the cells.
+     * @param begin The column of the first cell to write.
+     * @param end The column after the last cell to write.
+     * @param state The colors currently selected in the terminal, updated.
+     * @param destination Where to write.
+     * @return The end of the written bytes.
+     */
+    char* write_cells(const Frame& frame, const size_t cell_row, const size_t begin, const size_t end,
+                      ColorState& state, char* destination) const;
+
+    /**
+     * @brief Writes consecutive cells of a row as spaces on the pixel colors.
+     * @param pixel The first palette index to write.
+     * @param end The end of the palette indices to write.
+     * @param state The colors currently selected in the terminal, updated.
+     * @param destination Where to write.
+     * @return The end of the written bytes.
+     */
+    char* write_spaces(const uint8_t* pixel, const uint8_t* end, ColorState& state, char* destination) const;
+
+    /**
+     * @brief Writes consecutive cells of a row as half blocks (top pixel on bottom pixel).
+     * @param top The first palette index of the top row to write.
+     * @param bottom The first palette index of the bottom row to write (nullptr if the frame has no bottom row).
+     * @param count The number of cells to write.
+     * @param state The colors currently selected in the terminal, updated.
+     * @param destination Where to write.
+     * @return The end of the written bytes.
+     */
+    char* write_half_blocks(const uint8_t* top, const uint8_t* bottom, const size_t count,
+                            ColorState& state, char* destination) const;
+
+    /**
+     * @brief Writes an escape code.
+     * @param escape The escape code.
+     * @param destination Where to write (with room for a whole escape copy).
+     * @return The end of the written bytes.
+     */
+    static char* write_escape(const Escape& escape, char* destination) {
+        std::memcpy(destination, escape.bytes, sizeof(Escape));
+        return destination + escape.length;
+    }
+
+    /**
+     * @brief Writes a cursor positioning sequence.
+     * @param destination Where to write.
+     * @param row The row (0-based).
+     * @param column The column (0-based).
+     * @return The end of the written bytes.
+     */
+    static char* write_cursor_move(char* destination, const size_t row, const size_t column);
+
+    /**
+     * @brief Writes the decimal representation of a number.
+     * @param destination Where to write the digits.
+     * @param number The number.
+     * @return The number of digits written.
+     */
+    static size_t format_number(char* destination, size_t number);
 };
 
 #endif	// FRAME_H
-
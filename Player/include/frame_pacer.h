@@ -0,0 +1,117 @@
+#ifndef FRAME_PACER_H
+#define FRAME_PACER_H
+
+#include <array>
+#include <chrono>
+#include <cstddef>
+#include "printable.h"
+
+/**
+ * @struct JitterHistogram
+ * @brief Distribution of the frame start errors: how late the pacer woke up after each deadline.
+ */
+struct JitterHistogram : public Printable {
+    static const size_t BUCKETS = 8;	///< Number of buckets (the last one has no upper bound).
+    static const long long UPPER_BOUNDS_US[BUCKETS - 1];	///< Exclusive upper bound of each bucket, in microseconds.
+
+    std::array<size_t, BUCKETS> counts{};	///< Number of frame starts in each bucket.
+    size_t samples = 0;					///< Number of frame starts recorded.
+    long long total_us = 0;				///< Sum of the errors, in microseconds.
+    long long max_us = 0;				///< Largest error, in microseconds.
+
+    /**
+     * @brief Records the error of a frame start.
+     * @param error Time between the deadline and the wake-up.
+     */
+    void record(const std::chrono::steady_clock::duration error);
+
+    /**
+     * @brief Implements the Printable interface for printing the distribution.
+     * @param os The output stream to print to.
+     */
+    void print(std::ostream& os) const override;
+};
+
+/**
+ * @class FramePacer
+ * @brief Waits for the start of each frame, at absolute deadlines computed from the frame index and the period.
+ *
+ * Deadlines do not depend on when the previous waits ended, so sleep errors never accumulate. On Linux the
+ * pacer sleeps with clock_nanosleep(TIMER_ABSTIME) on the monotonic clock (the clock of std::chrono::steady_clock),
+ * elsewhere with std::this_thread::sleep_until. An optional spin tail wakes up early and busy-waits the end,
+ * trading CPU time for the scheduler wake-up latency.
+ */
+class FramePacer {
+public:
+    typedef std::chrono::steady_clock clock;	///< Clock of the deadlines.
+
+    /**
+     * @brief Constructor.
+     * @param period Time between the starts of two frames.
+     * @param spin Duration busy-waited before each deadline (0: sleep only).
+     */
+    explicit FramePacer(const clock::duration period = clock::duration::zero(),
+                        const clock::duration spin = clock::duration::zero())
+        : period(period), spin(spin) {}
+
+    /**
+     * @brief Starts counting frames: frame 0 is due at the given time.
+     * @param start_time Deadline of frame 0.
+     */
+    void start(const clock::time_point start_time) {
+        origin = start_time;
+    }
+
+    /**
+     * @brief Delays the deadlines of all the frames (e.g. to slow the video down rather than catch up).
+     * @param delay The delay.
+     */
+    void shift(const clock::duration delay) {
+        origin += delay;
+    }
+
+    /**
+     * @brief Gets the deadline of a frame.
+     * @param frame_index The index of the frame since the start.
+     * @return The time the frame is due.
+     */
+    clock::time_point deadline(const size_t frame_index) const {
+        return origin + period * static_cast<clock::rep>(frame_index);
+    }
+
+    /**
+     * @brief Gets the time between the starts of two frames.
+     * @return The period.
+     */
+    clock::duration get_period() const {
+        return period;
+    }
+
+    /**
+     * @brief Waits until a deadline, recording how late the wake-up was (nothing if the deadline already passed).
+     * @param deadline The deadline.
+     */
+    void wait_until(const clock::time_point deadline);
+
+    /**
+     * @brief Gets the distribution of the frame start errors since the pacer was created.
+     * @return The jitter histogram.
+     */
+    const JitterHistogram& get_jitter() const {
+        return jitter;
+    }
+
+private:
+    clock::duration period;		///< Time between the starts of two frames.
+    clock::duration spin;		///< Duration busy-waited before each deadline.
+    clock::time_point origin;	///< Deadline of frame 0.
+    JitterHistogram jitter;		///< Distribution of the frame start errors.
+
+    /**
+     * @brief Sleeps until a time point (may wake up a little later, never earlier).
+     * @param time_point The time point.
+     */
+    static void sleep_until(const clock::time_point time_point);
+};
+
+#endif	// FRAME_PACER_H
@@ -0,0 +1,151 @@
+#ifndef FRAME_POOL_H
+#define FRAME_POOL_H
+
+#include <vector>
+#include <memory>
+#include <mutex>
+#include "frame.h"
+
+class FramePool;
+
+/**
+ * @class FrameHandle
+ * @brief Move-only ownership of a frame borrowed from a FramePool: the frame goes back to the pool when released.
+ */
+class FrameHandle {
+public:
+    /**
+     * @brief Default constructor for an empty handle.
+     */
+    FrameHandle() : frame(nullptr), pool(nullptr) {}
+
+    /**
+     * @brief Constructor taking ownership of a frame of a pool.
+     * @param frame The borrowed frame.
+     * @param pool The pool to return the frame to.
+     */
+    FrameHandle(Frame* frame, FramePool* pool) : frame(frame), pool(pool) {}
+
+    FrameHandle(const FrameHandle&) = delete;
+    FrameHandle& operator=(const FrameHandle&) = delete;
+
+    /**
+     * @brief Move constructor: the other handle is left empty.
+     * @param other The handle to take the frame from.
+     */
+    FrameHandle(FrameHandle&& other) : frame(other.frame), pool(other.pool) {
+        other.frame = nullptr;
+        other.pool = nullptr;
+    }
+
+    /**
+     * @brief Move assignment: the current frame is released first, the other handle is left empty.
+     * @param other The handle to take the frame from.
+     * @return This handle.
+     */
+    FrameHandle& operator=(FrameHandle&& other);
+
+    /**
+     * @brief Destructor returning the frame to its pool.
+     */
+    ~FrameHandle() {
+        release();
+    }
+
+    /**
+     * @brief Returns the frame to its pool, leaving the handle empty.
+     */
+    void release();
+
+    Frame& operator*() const {
+        return *frame;
+    }
+
+    Frame* operator->() const {
+        return frame;
+    }
+
+    /**
+     * @brief Checks whether the handle owns a frame.
+     */
+    explicit operator bool() const {
+        return frame != nullptr;
+    }
+
+private:
+    Frame* frame;		///< The borrowed frame (null if empty).
+    FramePool* pool;	///< The pool owning the frame.
+};
+
+/**
+ * @class FramePool
+ * @brief Recycles pre-sized frames, so that decoding and rendering do not allocate once the pool is large enough.
+ *
+ * Frames can be acquired and released from different threads. The pool must outlive all its handles.
+ * The pool also recycles the palettes shared by the frames of a cluster: frames drop their palette
+ * when they come back to the pool, so a palette is free again once it is only referenced by the pool.
+ */
+class FramePool {
+public:
+    /**
+     * @brief Default constructor for an empty pool.
+     */
+    FramePool() : width(0), height(0) {}
+
+    FramePool(const FramePool&) = delete;
+    FramePool& operator=(const FramePool&) = delete;
+
+    /**
+     * @brief Sets the frame dimensions and allocates frames (and enough palettes for them) in advance.
+     * Must not be called while frames are borrowed.
+     * @param width Width of the frames.
+     * @param height Height of the frames.
+     * @param reserved Number of frames to allocate.
+     */
+    void setup(const size_t width, const size_t height, const size_t reserved);
+
+    /**
+     * @brief Borrows a frame, allocating a new one only if all the frames are in use.
+     * The content of the frame is the one left by its previous user.
+     * @return A handle to a frame of the pool dimensions.
+     */
+    FrameHandle acquire();
+
+    /**
+     * @brief Gets a palette no frame refers to, allocating a new one only if all the palettes are in use.
+     * Must always be called by the same thread.
+     * @return A palette to fill and share among the frames of a cluster.
+     */
+    std::shared_ptr<Palette> acquire_palette();
+
+    /**
+     * @brief Gets the number of frames allocated by the pool.
+     * @return The number of frames.
+     */
+    size_t size() const;
+
+private:
+    friend class FrameHandle;
+
+    /**
+     * @brief Takes a frame back (called by FrameHandle::release).
+     * @param frame The frame to take back.
+     */
+    void recycle(Frame* frame);
+
+    /**
+     * @brief Allocates a frame of the pool dimensions.
+     * @return The new frame, owned by the pool.
+     */
+    Frame* allocate_frame();
+
+    size_t width, height;						///< Dimensions of the frames.
+    std::vector<std::unique_ptr<Frame>> frames;	///< All the frames allocated by the pool.
+    std::vector<Frame*> free_frames;			///< Frames not borrowed (capacity kept at least `frames.size()`).
+    std::vector<std::shared_ptr<Palette>> palettes;	///< All the palettes allocated by the pool.
+    size_t next_palette = 0;					///< Index of the palette to check first for reuse.
+    uint64_t next_palette_id = 1;				///< Identifier given to the next palette handed out.
+    mutable std::mutex mutex;					///< Protects the frame lists and the palette references held by frames.
+};
+
+#endif	// FRAME_POOL_H
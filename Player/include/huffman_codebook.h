@@ -9,7 +9,8 @@
 
 /**
  * @class HuffmanCodebook
- * @brief Template for a Huffman codebook, with support for Printable and non-Printable types.
+ * @brief Template for a Huffman codebook, with support for Printable and non-Printable types
+ * (the latter are printed with their own stream insertion operator, as Color).
  */
 template <typename T>
 class HuffmanCodebook {
@@ -0,0 +1,234 @@
+#ifndef HUFFMAN_DECODER_H
+#define HUFFMAN_DECODER_H
+
+#include <vector>
+#include <string>
+#include <algorithm>
+#include <stdexcept>
+#include <cstdint>
+#include "bit_reader.h"
+#include "huffman_codebook.h"
+
+/**
+ * @class HuffmanDecoder
+ * @brief Table-driven Huffman decoder: resolves a symbol and its code length with one or two table lookups.
+ *
+ * Codes up to ROOT_BITS long are resolved by the root table, indexed by the next `root_bits` bits of the stream.
+ * Longer codes go through a second-level table linked from the root entry sharing their prefix.
+ * As for the string-keyed HuffmanCodebook, the shortest matching code wins and a duplicated code keeps the last value.
+ */
+template <typename T>
+class HuffmanDecoder {
+public:
+    static const size_t MAX_CODE_LENGTH = 16;	///< Longest supported code length (in bits).
+    static const size_t ROOT_BITS = 10;			///< Maximum index width (in bits) of the root table.
+    static const size_t INVALID_SYMBOL = static_cast<size_t>(-1);	///< Returned when no code matches.
+
+    /**
+     * @brief Inserts a value with its corresponding Huffman code. Tables are rebuilt by build().
+     * @param code The Huffman code, right-aligned (its first bit is the most significant one).
+     * @param length The length of the code in bits.
+     * @param value The value to associate with the code.
+     * @throws std::invalid_argument If the code length is 0 or exceeds MAX_CODE_LENGTH.
+     */
+    void insert(uint32_t code, size_t length, const T& value) {
+        if (length == 0 || length > MAX_CODE_LENGTH) {
+            throw std::invalid_argument("Invalid Huffman code length: " + std::to_string(length));
+        }
+        codes.push_back(Code{code & ((1u << length) - 1), static_cast<uint8_t>(length)});
+        values.push_back(value);
+    }
+
+    /**
+     * @brief Removes all codes and tables, keeping the allocated memory for reuse.
+     */
+    void clear() {
+        codes.clear();
+        values.clear();
+        table.clear();
+        max_length = root_bits = 0;
+    }
+
+    /**
+     * @brief Builds the lookup tables from the inserted codes.
+     */
+    void build() {
+        max_length = 0;
+        for (const Code& c : codes) {
+            max_length = std::max(max_length, static_cast<size_t>(c.length));
+        }
+        root_bits = std::min(max_length, ROOT_BITS);
+        table.assign(static_cast<size_t>(1) << root_bits, Entry{0, 0, 0});
+
+        // Link a second-level table to every root entry that prefixes a code longer than root_bits
+        for (const Code& c : codes) {
+            if (c.length > root_bits) {
+                Entry& link = table[c.code >> (c.length - root_bits)];
+                link.sub_bits = std::max(link.sub_bits, static_cast<uint8_t>(c.length - root_bits));
+            }
+        }
+        for (size_t i = 0, n = table.size(); i < n; ++i) {
+            if (table[i].sub_bits) {
+                table[i].index = static_cast<uint32_t>(table.size());
+                table.resize(table.size() + (static_cast<size_t>(1) << table[i].sub_bits), Entry{0, 0, 0});
+            }
+        }
+
+        // Fill longest codes first: shorter ones overwrite them, as the shortest match is the one decoded
+        for (size_t length = max_length; length > 0; --length) {
+            for (size_t symbol = 0; symbol < codes.size(); ++symbol) {
+                if (codes[symbol].length != length) {
+                    continue;
+                }
+                const Code& c = codes[symbol];
+                Entry entry{static_cast<uint32_t>(symbol), c.length, 0};
+                size_t first, count;
+                if (c.length <= root_bits) {
+                    first = static_cast<size_t>(c.code) << (root_bits - c.length);
+                    count = static_cast<size_t>(1) << (root_bits - c.length);
+                } else {
+                    const Entry& link = table[c.code >> (c.length - root_bits)];
+                    if (!link.sub_bits) {
+                        continue;  // a shorter code already shadows this prefix
+                    }
+                    size_t suffix_length = c.length - root_bits;
+                    size_t suffix = c.code & ((1u << suffix_length) - 1);
+                    first = link.index + (suffix << (link.sub_bits - suffix_length));
+                    count = static_cast<size_t>(1) << (link.sub_bits - suffix_length);
+                }
+                std::fill(table.begin() + first, table.begin() + first + count, entry);
+            }
+        }
+    }
+
+    /**
+     * @brief Decodes the next symbol from the bit reader and consumes its code.
+     * @tparam BUFFERED Whether the reader is known to buffer max_code_length() bits (see BitReader::ensure),
+     *         so that the bits are taken from its buffer without any check.
+     * @param reader The bit reader positioned at the start of a code.
+     * @return The index of the decoded symbol (in insertion order), or INVALID_SYMBOL if no code matches.
+     * @throws std::out_of_range If the matching code extends beyond the end of the data.
+     */
+    template <bool BUFFERED = false>
+    inline size_t decode_symbol(BitReader& reader) const {
+        uint32_t bits = static_cast<uint32_t>(BUFFERED ? reader.peek_buffered(max_length) : reader.peek(max_length));
+        const Entry& entry = find(bits);
+        if (!entry.length) {
+            return INVALID_SYMBOL;
+        }
+        if (BUFFERED) {
+            reader.consume_buffered(entry.length);
+        } else {
+            reader.consume(entry.length);
+        }
+        return entry.index;
+    }
+
+    /**
+     * @brief Resolves the code starting a window of bits, without a reader (e.g. to build derived tables).
+     * @param bits The next max_code_length() bits, the first one being the most significant.
+     * @param length Output parameter to hold the length of the code (0 if no code matches).
+     * @return The index of the symbol (in insertion order), or INVALID_SYMBOL if no code matches.
+     */
+    size_t lookup(uint32_t bits, size_t& length) const {
+        const Entry& entry = find(bits);
+        length = entry.length;
+        return entry.length ? entry.index : INVALID_SYMBOL;
+    }
+
+    /**
+     * @brief Retrieves the value of a decoded symbol.
+     * @param symbol The symbol index returned by decode_symbol().
+     * @return The associated value.
+     */
+    inline const T& value(size_t symbol) const {
+        return values[symbol];
+    }
+
+    /**
+     * @brief Retrieves the length of the code of a symbol.
+     * @param symbol The symbol index (in insertion order).
+     * @return The length of its code in bits.
+     */
+    inline size_t code_length(size_t symbol) const {
+        return codes[symbol].length;
+    }
+
+    /**
+     * @brief Returns the length of the longest code (known once the tables are built).
+     * @return The length in bits.
+     */
+    size_t max_code_length() const {
+        return max_length;
+    }
+
+    /**
+     * @brief Returns the number of codes in the decoder.
+     * @return The number of entries.
+     */
+    size_t size() const {
+        return codes.size();
+    }
+
+    /**
+     * @brief Converts the codes into a string-keyed HuffmanCodebook (e.g. for debug printing).
+     * @return The equivalent HuffmanCodebook.
+     */
+    HuffmanCodebook<T> to_codebook() const {
+        HuffmanCodebook<T> codebook;
+        for (size_t i = 0; i < codes.size(); ++i) {
+            std::string code;
+            for (size_t bit = codes[i].length; bit-- > 0;) {
+                code.push_back(((codes[i].code >> bit) & 1) ? '1' : '0');
+            }
+            codebook.insert(code, values[i]);
+        }
+        return codebook;
+    }
+
+private:
+    /**
+     * @struct Code
+     * @brief A right-aligned Huffman code with its length.
+     */
+    struct Code {
+        uint32_t code;	///< Code bits.
+        uint8_t length;	///< Code length in bits.
+    };
+
+    /**
+     * @struct Entry
+     * @brief A lookup table entry: a decoded symbol, or a link to a second-level table.
+     */
+    struct Entry {
+        uint32_t index;		///< Symbol index, or offset of the second-level table if sub_bits != 0.
+        uint8_t length;		///< Code length in bits (0 if no code matches).
+        uint8_t sub_bits;	///< Index width of the linked second-level table (0 if not a link).
+    };
+
+    /**
+     * @brief Finds the table entry of the code starting a window of bits.
+     * @param bits The next max_length bits, the first one being the most significant.
+     * @return The entry of the code (its length is 0 if no code matches).
+     */
+    inline const Entry& find(uint32_t bits) const {
+        const Entry* entry = &table[bits >> (max_length - root_bits)];
+        if (entry->sub_bits) {
+            size_t shift = max_length - root_bits - entry->sub_bits;
+            entry = &table[entry->index + ((bits >> shift) & ((1u << entry->sub_bits) - 1))];
+        }
+        return *entry;
+    }
+
+    std::vector<Code> codes;	///< Inserted codes.
+    std::vector<T> values;		///< Values associated with the codes.
+    std::vector<Entry> table;	///< Root table followed by the second-level tables.
+    size_t max_length = 0;		///< Longest code length.
+    size_t root_bits = 0;		///< Index width of the root table.
+};
+
+template <typename T> const size_t HuffmanDecoder<T>::MAX_CODE_LENGTH;
+template <typename T> const size_t HuffmanDecoder<T>::ROOT_BITS;
+template <typename T> const size_t HuffmanDecoder<T>::INVALID_SYMBOL;
+
+#endif	// HUFFMAN_DECODER_H
@@ -0,0 +1,98 @@
+#ifndef MULTI_SYMBOL_TABLE_H
+#define MULTI_SYMBOL_TABLE_H
+
+#include <vector>
+#include <cstdint>
+#include <stdexcept>
+#include "huffman_decoder.h"
+
+/**
+ * @class MultiSymbolTable
+ * @brief Lookup table resolving several consecutive short Huffman codes at once.
+ *
+ * The table is indexed by the next TABLE_BITS bits of the stream: each entry holds the symbols of the
+ * codes lying entirely within these bits (up to MAX_SYMBOLS) and their total length. It is derived from
+ * a built HuffmanDecoder with at most 256 symbols and codes up to TABLE_BITS long, so that the first code
+ * of a window always fits in it: an entry without symbols means that no code matches.
+ */
+class MultiSymbolTable {
+public:
+    static const size_t TABLE_BITS = 12;	///< Index width (in bits) of the table.
+    static const size_t MAX_SYMBOLS = 4;	///< Maximum number of symbols resolved by an entry.
+
+    /**
+     * @struct Entry
+     * @brief The symbols of the codes starting a window of TABLE_BITS bits.
+     */
+    struct Entry {
+        uint8_t symbols[MAX_SYMBOLS];	///< Decoded symbols (the ones beyond `count` are unspecified).
+        uint8_t count;					///< Number of symbols (0 if no code matches).
+        uint8_t length;					///< Total length of their codes in bits.
+    };
+
+    /**
+     * @brief Checks whether a table can be derived from a decoder.
+     * @param decoder The built Huffman decoder.
+     * @return True if the decoder has at most 256 symbols and codes up to TABLE_BITS long.
+     */
+    template <typename T>
+    static bool supports(const HuffmanDecoder<T>& decoder) {
+        return decoder.size() <= 256 && decoder.max_code_length() <= TABLE_BITS;
+    }
+
+    /**
+     * @brief Builds the table from the codes of a decoder (reusing the memory of the previous table).
+     * @param decoder The built Huffman decoder (see supports).
+     * @throws std::invalid_argument If the decoder is not supported.
+     */
+    template <typename T>
+    void build(const HuffmanDecoder<T>& decoder) {
+        if (!supports(decoder)) {
+            throw std::invalid_argument("Huffman codes not supported by the multi-symbol table");
+        }
+        size_t max_length = decoder.max_code_length();
+        table.resize(static_cast<size_t>(1) << TABLE_BITS);
+        total_symbols = 0;
+        for (size_t window = 0; window < table.size(); ++window) {
+            Entry& entry = table[window];
+            entry = Entry{{0, 0, 0, 0}, 0, 0};
+            // Resolve the codes one after the other: a code is kept only if it ends within the window
+            while (entry.count < MAX_SYMBOLS && max_length > 0) {
+                uint32_t bits = static_cast<uint32_t>(((window << entry.length) & (table.size() - 1))
+                                                      >> (TABLE_BITS - max_length));
+                size_t length;
+                size_t symbol = decoder.lookup(bits, length);
+                if (symbol == HuffmanDecoder<T>::INVALID_SYMBOL || entry.length + length > TABLE_BITS) {
+                    break;
+                }
+                entry.symbols[entry.count++] = static_cast<uint8_t>(symbol);
+                entry.length = static_cast<uint8_t>(entry.length + length);
+            }
+            total_symbols += entry.count;
+        }
+    }
+
+    /**
+     * @brief Gets the average number of symbols of the entries, that is per lookup on a Huffman-coded stream
+     * (whose bits are close to uniformly distributed).
+     * @return The average number of symbols (0 if the table is not built).
+     */
+    double average_symbols() const {
+        return table.empty() ? 0 : static_cast<double>(total_symbols) / table.size();
+    }
+
+    /**
+     * @brief Gets the entry of a window of bits.
+     * @param bits The next TABLE_BITS bits, the first one being the most significant.
+     * @return The entry of the window.
+     */
+    inline const Entry& lookup(uint32_t bits) const {
+        return table[bits];
+    }
+
+private:
+    std::vector<Entry> table;	///< Entries indexed by windows of TABLE_BITS bits.
+    size_t total_symbols = 0;	///< Sum of the number of symbols of the entries.
+};
+
+#endif	// MULTI_SYMBOL_TABLE_H
@@ -0,0 +1,100 @@
+#ifndef OUTPUT_SINK_H
+#define OUTPUT_SINK_H
+
+#include <string>
+#include <chrono>
+#include <cstddef>
+
+/**
+ * @class OutputSink
+ * @brief Writes rendered frames to the standard output, each with a single system call.
+ *
+ * Frames bypass the buffering of std::cout, which copies them and may split them across several writes:
+ * a frame written in pieces can be displayed half updated (tearing). When enabled and the output is a terminal,
+ * frames are also wrapped in synchronized update markers (DEC private mode 2026): terminals supporting the mode
+ * display a frame only once complete, the others ignore the markers.
+ *
+ * A slow terminal (e.g. over SSH) blocks the writes: the sink measures the time spent in writes and, where the
+ * system tells, the bytes still queued for the terminal, so that the player can adapt.
+ */
+class OutputSink {
+public:
+    typedef std::chrono::steady_clock clock;	///< Clock of the write time measurements.
+
+    /**
+     * @brief Constructor for the standard output (anything already written to std::cout is flushed first).
+     * @param synchronized_updates Whether to wrap frames in synchronized update markers (only if the output is a terminal).
+     */
+    explicit OutputSink(const bool synchronized_updates = true);
+
+    OutputSink(const OutputSink&) = delete;
+    OutputSink& operator=(const OutputSink&) = delete;
+
+    /**
+     * @brief Writes a frame at once, retrying until the whole frame is written.
+     * @param frame The bytes of the frame.
+     * @throws std::runtime_error If the output cannot be written.
+     */
+    void write_frame(const std::string& frame);
+
+    /**
+     * @brief Checks whether frames are wrapped in synchronized update markers.
+     * @return True if they are.
+     */
+    bool synchronized() const {
+        return synchronized_updates;
+    }
+
+    /**
+     * @brief Gets the number of write system calls made so far.
+     * @return The number of calls.
+     */
+    size_t get_write_calls() const {
+        return write_calls;
+    }
+
+    /**
+     * @brief Gets the time spent writing the last frame (blocked, if the output was not taking the bytes).
+     * @return The duration of the last write_frame.
+     */
+    clock::duration get_last_write_time() const {
+        return last_write_time;
+    }
+
+    /**
+     * @brief Gets the total time spent writing frames.
+     * @return The duration of all the write_frame calls.
+     */
+    clock::duration get_write_time() const {
+        return write_time;
+    }
+
+    /**
+     * @brief Gets the number of bytes written but not sent by the system yet: the output queue of a terminal
+     * (TIOCOUTQ) or the content of a pipe (FIONREAD). Linux only.
+     * @return The number of bytes, 0 if unknown.
+     */
+    size_t queued_bytes() const;
+
+private:
+    static const char SYNC_BEGIN[];				///< Output bytes starting a synchronized update.
+    static const char SYNC_END[];				///< Output bytes ending a synchronized update.
+    static const size_t SYNC_MARKER_LENGTH = 8;	///< Length of SYNC_BEGIN and SYNC_END.
+
+    bool terminal;				///< Whether the standard output is a terminal.
+    bool synchronized_updates;	///< Whether frames are wrapped in synchronized update markers.
+    size_t write_calls = 0;		///< Number of write system calls made.
+    clock::duration last_write_time = clock::duration::zero();	///< Time spent writing the last frame.
+    clock::duration write_time = clock::duration::zero();		///< Total time spent writing frames.
+#ifdef _WIN32
+    std::string buffer;			///< Frame wrapped in the markers (WriteFile has no gather variant).
+#endif
+
+    /**
+     * @brief Checks whether the standard output is a terminal.
+     * @return True for a terminal, false for a file or a pipe.
+     */
+    static bool is_terminal();
+};
+
+#endif	// OUTPUT_SINK_H
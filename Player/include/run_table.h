@@ -0,0 +1,94 @@
+#ifndef RUN_TABLE_H
+#define RUN_TABLE_H
+
+#include <vector>
+#include <cstdint>
+#include <stdexcept>
+#include "color.h"
+#include "huffman_decoder.h"
+
+/**
+ * @class RunTable
+ * @brief Lookup table resolving a palette code and the following run length code at once (RLE+Huffman frames).
+ *
+ * The table is indexed by the next TABLE_BITS bits of the stream: each entry holds the palette symbol and the
+ * run length of the pair of codes starting the window, with their total length, if both lie within the window.
+ * Otherwise the entry has a length of 0 and the codes are decoded one after the other.
+ */
+class RunTable {
+public:
+    static const size_t TABLE_BITS = 12;	///< Index width (in bits) of the table.
+
+    /**
+     * @struct Entry
+     * @brief The run starting a window of TABLE_BITS bits.
+     */
+    struct Entry {
+        uint16_t count;		///< Run length.
+        uint8_t symbol;		///< Palette symbol.
+        uint8_t length;		///< Total length of the two codes in bits (0 if they do not fit in the window).
+    };
+
+    /**
+     * @brief Checks whether a table can be derived from a palette decoder.
+     * @param colors The built palette decoder.
+     * @return True if the palette has at most 256 symbols.
+     */
+    static bool supports(const HuffmanDecoder<Color>& colors) {
+        return colors.size() <= 256;
+    }
+
+    /**
+     * @brief Builds the table from the codes of the palette and of the run lengths (reusing the memory of the previous table).
+     * @param colors The built palette decoder (see supports).
+     * @param counts The built run lengths decoder (lengths up to 65535).
+     * @throws std::invalid_argument If the palette is not supported.
+     */
+    void build(const HuffmanDecoder<Color>& colors, const HuffmanDecoder<size_t>& counts) {
+        if (!supports(colors)) {
+            throw std::invalid_argument("palette not supported by the run table");
+        }
+        const uint32_t mask = (1u << TABLE_BITS) - 1;
+        table.resize(static_cast<size_t>(1) << TABLE_BITS);
+        for (uint32_t window = 0; window < table.size(); ++window) {
+            Entry& entry = table[window];
+            entry = Entry{0, 0, 0};
+            size_t color_length, count_length;
+            size_t color = colors.lookup(align(window, colors.max_code_length()), color_length);
+            if (color == HuffmanDecoder<Color>::INVALID_SYMBOL || color_length > TABLE_BITS) {
+                continue;
+            }
+            size_t count = counts.lookup(align((window << color_length) & mask, counts.max_code_length()), count_length);
+            if (count == HuffmanDecoder<size_t>::INVALID_SYMBOL || color_length + count_length > TABLE_BITS
+                || counts.value(count) > UINT16_MAX) {
+                continue;
+            }
+            entry = Entry{static_cast<uint16_t>(counts.value(count)), static_cast<uint8_t>(color),
+                          static_cast<uint8_t>(color_length + count_length)};
+        }
+    }
+
+    /**
+     * @brief Gets the entry of a window of bits.
+     * @param bits The next TABLE_BITS bits, the first one being the most significant.
+     * @return The entry of the window.
+     */
+    inline const Entry& lookup(uint32_t bits) const {
+        return table[bits];
+    }
+
+private:
+    /**
+     * @brief Takes the first bits of a window, as many as a decoder looks up (padded with zeros if beyond the window).
+     * @param window The window of TABLE_BITS bits.
+     * @param bits The number of bits looked up by the decoder.
+     * @return The bits, the first one being the most significant.
+     */
+    static uint32_t align(uint32_t window, size_t bits) {
+        return bits <= TABLE_BITS ? window >> (TABLE_BITS - bits) : window << (bits - TABLE_BITS);
+    }
+
+    std::vector<Entry> table;	///< Entries indexed by windows of TABLE_BITS bits.
+};
+
+#endif	// RUN_TABLE_H
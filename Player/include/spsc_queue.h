@@ -0,0 +1,132 @@
+#ifndef SPSC_QUEUE_H
+#define SPSC_QUEUE_H
+
+#include <vector>
+#include <atomic>
+#include <mutex>
+#include <condition_variable>
+#include <utility>
+#include <cstddef>
+
+/**
+ * @class SPSCQueue
+ * @brief Bounded lock-free queue for exactly one producer thread and one consumer thread.
+ *
+ * The producer only writes `tail` and the consumer only writes `head`: each side publishes its
+ * progress with a release store that the other side reads with an acquire load, so no lock is needed.
+ * A side that cannot go on (e.g. a full queue) blocks in wait() until the other side pushes or pops: the
+ * lock is only taken when a thread is waiting, so the calls that do not block stay lock-free.
+ */
+template <typename T>
+class SPSCQueue {
+public:
+    /**
+     * @brief Constructor to initialize the queue with a fixed capacity.
+     * @param capacity Maximum number of elements in the queue.
+     */
+    explicit SPSCQueue(size_t capacity = 0) : slots(capacity) {}
+
+    SPSCQueue(const SPSCQueue&) = delete;
+    SPSCQueue& operator=(const SPSCQueue&) = delete;
+
+    /**
+     * @brief Empties the queue and changes its capacity. Must not be called while the queue is in use.
+     * @param capacity Maximum number of elements in the queue.
+     */
+    void reset(size_t capacity) {
+        slots = std::vector<T>(capacity);
+        head.store(0, std::memory_order_relaxed);
+        tail.store(0, std::memory_order_relaxed);
+    }
+
+    /**
+     * @brief Appends an element (producer side).
+     * @param value The element to move into the queue. Left untouched if the queue is full.
+     * @return True if the element has been appended, false if the queue is full.
+     */
+    bool try_push(T&& value) {
+        size_t current_tail = tail.load(std::memory_order_relaxed);
+        if (current_tail - head.load(std::memory_order_acquire) == slots.size()) {
+            return false;
+        }
+        slots[current_tail % slots.size()] = std::move(value);
+        tail.store(current_tail + 1, std::memory_order_release);
+        notify();
+        return true;
+    }
+
+    /**
+     * @brief Removes the oldest element (consumer side).
+     * @param value Output parameter to hold the element removed.
+     * @return True if an element has been removed, false if the queue is empty.
+     */
+    bool try_pop(T& value) {
+        size_t current_head = head.load(std::memory_order_relaxed);
+        if (tail.load(std::memory_order_acquire) == current_head) {
+            return false;
+        }
+        value = std::move(slots[current_head % slots.size()]);
+        head.store(current_head + 1, std::memory_order_release);
+        notify();
+        return true;
+    }
+
+    /**
+     * @brief Blocks until a condition holds, checking it again after every push, pop or notify().
+     * @param ready The condition, e.g. on size(), or on flags set by the caller before a notify().
+     */
+    template <typename Predicate>
+    void wait(Predicate ready) {
+        if (ready()) {
+            return;
+        }
+        std::unique_lock<std::mutex> lock(mutex);
+        waiters.fetch_add(1);
+        std::atomic_thread_fence(std::memory_order_seq_cst);  // the count is seen before the condition is checked
+        condition.wait(lock, ready);
+        waiters.fetch_sub(1);
+    }
+
+    /**
+     * @brief Wakes the threads in wait() to check their condition again (called by push and pop, and by the owner
+     *        of the queue after changing the other variables of a condition).
+     */
+    void notify() {
+        std::atomic_thread_fence(std::memory_order_seq_cst);  // the change is seen before the count of waiters
+        if (waiters.load(std::memory_order_relaxed)) {
+            std::lock_guard<std::mutex> lock(mutex);
+            condition.notify_all();
+        }
+    }
+
+    /**
+     * @brief Gets the number of elements in the queue (a snapshot, if the queue is in use).
+     * @return The number of elements.
+     */
+    size_t size() const {
+        size_t current_head = head.load(std::memory_order_acquire);
+        return tail.load(std::memory_order_acquire) - current_head;
+    }
+
+    /**
+     * @brief Gets the maximum number of elements in the queue.
+     * @return The capacity.
+     */
+    size_t capacity() const {
+        return slots.size();
+    }
+
+private:
+    static const size_t CACHE_LINE_SIZE = 64;	///< Size of a cache line, to keep the indices apart.
+
+    std::vector<T> slots;	///< Ring of elements (indexed modulo the capacity).
+    char head_padding[CACHE_LINE_SIZE];					///< Keeps `head` off the cache line of `slots`.
+    std::atomic<size_t> head{0};						///< Number of elements ever removed (consumer-owned).
+    char tail_padding[CACHE_LINE_SIZE - sizeof(std::atomic<size_t>)];	///< Keeps `tail` off the cache line of `head`.
+    std::atomic<size_t> tail{0};						///< Number of elements ever appended (producer-owned).
+    std::mutex mutex;						///< Guards the waits (only taken when a thread is waiting).
+    std::condition_variable condition;		///< Notified after pushes and pops while a thread is waiting.
+    std::atomic<size_t> waiters{0};			///< Number of threads in wait().
+};
+
+#endif	// SPSC_QUEUE_H
@@ -0,0 +1,208 @@
+#include <iostream>
+#include <iomanip>
+#include <string>
+#include <vector>
+#include <random>
+#include <chrono>
+#include <cstring>
+#include <stdexcept>
+#include "simd_kernels.h"
+
+using namespace std;
+
+typedef SimdKernels::Level Level;
+typedef chrono::steady_clock Clock;
+
+/**
+ * @brief Lists the levels supported by the CPU, from the scalar reference up.
+ * @return The levels.
+ */
+static vector<Level> supported_levels() {
+    vector<Level> levels;
+    for (Level level : {Level::SCALAR, Level::SSE4, Level::AVX2}) {
+        if (level <= SimdKernels::detect()) {
+            levels.push_back(level);
+        }
+    }
+    return levels;
+}
+
+/**
+ * @brief Writes escape codes the way the renderer did before the padded records: each code copied at its length.
+ * @return The end of the written bytes.
+ */
+static char* write_escapes_reference(char* destination, const uint8_t* pixels, const size_t count,
+                                     const uint8_t* terminal_colors, const SimdKernels::Escape* escapes,
+                                     const char character) {
+    for (size_t i = 0; i < count; ++i) {
+        const SimdKernels::Escape& escape = escapes[terminal_colors[pixels[i]]];
+        std::memcpy(destination, escape.bytes, escape.length);
+        destination += escape.length;
+        *destination++ = character;
+    }
+    return destination;
+}
+
+/**
+ * @brief Fills escape records with codes of random lengths (up to the longest 24-bit color code).
+ * @param escapes The 256 records.
+ * @param random The random generator.
+ */
+static void generate_escapes(vector<SimdKernels::Escape>& escapes, mt19937& random) {
+    for (SimdKernels::Escape& escape : escapes) {
+        escape.length = static_cast<uint8_t>(4 + random() % 16);
+        for (char& byte : escape.bytes) {
+            byte = static_cast<char>('0' + random() % 64);
+        }
+    }
+}
+
+/**
+ * @brief Compares the kernels of every supported level with the scalar reference on random rows.
+ * @param cases The number of random rows.
+ * @return The number of mismatches.
+ */
+static size_t check(const size_t cases) {
+    mt19937 random(2024);
+    size_t mismatches = 0;
+    vector<SimdKernels::Escape> escapes(256);
+    vector<uint8_t> terminal_colors(256);
+    for (size_t i = 0; i < cases; ++i) {
+        // Rows of any length (around the vector widths), with identical pixels more or less often
+        size_t count = random() % (i % 4 == 0 ? 1000 : 80);
+        size_t change_rate = 1 + random() % 8;
+        vector<uint8_t> pixels(count), previous(count), marks(count);
+        for (size_t x = 0; x < count; ++x) {
+            previous[x] = static_cast<uint8_t>(random());
+            pixels[x] = random() % change_rate == 0 ? static_cast<uint8_t>(random()) : previous[x];
+            marks[x] = random() % 4 == 0;
+        }
+
+        SimdKernels::set_level(Level::SCALAR);
+        vector<uint8_t> expected_marks = marks;
+        size_t expected_marked = SimdKernels::mark_changes(pixels.data(), previous.data(), count, expected_marks.data());
+        for (Level level : supported_levels()) {
+            SimdKernels::set_level(level);
+            vector<uint8_t> level_marks = marks;
+            size_t marked = SimdKernels::mark_changes(pixels.data(), previous.data(), count, level_marks.data());
+            if (marked != expected_marked || level_marks != expected_marks) {
+                cerr << "mark_changes (" << SimdKernels::level_name(level) << ") differs on " << count << " pixels\n";
+                ++mismatches;
+            }
+        }
+
+        // write_escapes has a single version: checked against copies of the exact lengths
+        generate_escapes(escapes, random);
+        for (uint8_t& color : terminal_colors) {
+            color = static_cast<uint8_t>(random());
+        }
+        vector<char> expected(count * 20 + sizeof(SimdKernels::Escape)), written(expected.size());
+        char* expected_end = write_escapes_reference(expected.data(), pixels.data(), count, terminal_colors.data(),
+                                                     escapes.data(), ' ');
+        char* end = SimdKernels::write_escapes(written.data(), pixels.data(), count, terminal_colors.data(),
+                                               escapes.data(), ' ');
+        if (expected_end - expected.data() != end - written.data()
+            || !std::equal(expected.data(), expected_end, written.data())) {
+            cerr << "write_escapes differs on " << count << " pixels\n";
+            ++mismatches;
+        }
+    }
+    SimdKernels::set_level(Level::AVX2);
+    return mismatches;
+}
+
+/**
+ * @brief Measures the kernels of every supported level on a row.
+ * @param pixels The number of pixels of the row.
+ * @param repeat The runs of each measure (the fastest one is reported).
+ */
+static void bench(const size_t pixels, const size_t repeat) {
+    mt19937 random(2024);
+    vector<uint8_t> row(pixels), previous(pixels), marks(pixels), terminal_colors(256);
+    for (size_t x = 0; x < pixels; ++x) {
+        previous[x] = random() % 16;
+        row[x] = random() % 4 == 0 ? random() % 16 : previous[x];
+    }
+    for (uint8_t& color : terminal_colors) {
+        color = static_cast<uint8_t>(random());
+    }
+    vector<SimdKernels::Escape> escapes(256);
+    generate_escapes(escapes, random);
+    vector<char> output(pixels * 20 + sizeof(SimdKernels::Escape));
+
+    size_t sink = 0;  // results kept alive
+    for (Level level : supported_levels()) {
+        SimdKernels::set_level(level);
+        double best = 0;
+        for (size_t run = 0; run < repeat; ++run) {
+            std::fill(marks.begin(), marks.end(), 0);
+            Clock::time_point start = Clock::now();
+            sink += SimdKernels::mark_changes(row.data(), previous.data(), pixels, marks.data());
+            double seconds = chrono::duration<double>(Clock::now() - start).count();
+            best = run == 0 ? seconds : min(best, seconds);
+        }
+        cout << "mark_changes  " << left << setw(8) << SimdKernels::level_name(level) << right << fixed
+             << setprecision(3) << setw(8) << best * 1e9 / pixels << " ns/px\n";
+    }
+    SimdKernels::set_level(Level::AVX2);
+
+    double best = 0;
+    for (size_t run = 0; run < repeat; ++run) {
+        Clock::time_point start = Clock::now();
+        sink += SimdKernels::write_escapes(output.data(), row.data(), pixels, terminal_colors.data(), escapes.data(),
+                                           ' ') - output.data();
+        double seconds = chrono::duration<double>(Clock::now() - start).count();
+        best = run == 0 ? seconds : min(best, seconds);
+    }
+    cout << "write_escapes " << left << setw(8) << "scalar" << right << fixed << setprecision(3)
+         << setw(8) << best * 1e9 / pixels << " ns/px\n";
+    if (sink == 0) {
+        cout << "\n";
+    }
+}
+
+int main(int argc, char* argv[]) {
+    try {
+        bool only_check = false;
+        size_t pixels = 1 << 16, repeat = 7;
+        for (int i = 1; i < argc; ++i) {
+            string arg = argv[i];
+            if (arg == "--check") {
+                only_check = true;
+            } else if (arg == "--pixels" && i + 1 < argc) {
+                pixels = stoul(argv[++i]);
+            } else if (arg == "--repeat" && i + 1 < argc) {
+                repeat = stoul(argv[++i]);
+            } else {
+                throw invalid_argument("Unknown argument: " + arg);
+            }
+        }
+        if (!pixels || !repeat) {
+            throw invalid_argument("the pixels and runs must be positive");
+        }
+
+        cout << "SIMD kernels: " << SimdKernels::level_name(SimdKernels::level()) << " (levels checked:";
+        for (Level level : supported_levels()) {
+            cout << " " << SimdKernels::level_name(level);
+        }
+        cout << ")\n";
+        size_t mismatches = check(20000);
+        cout << "check: " << (mismatches ? to_string(mismatches) + " mismatches" : "every level matches the scalar reference")
+             << "\n";
+        if (mismatches) {
+            return 1;
+        }
+        if (!only_check) {
+            bench(pixels, repeat);
+        }
+
+    } catch (const exception& e) {
+        cerr << "Fatal error: " << e.what() << "\n"
+             << "Syntax: simd_bench [--check] [--pixels N] [--repeat N]\n"
+             << "  [--check]: only compare the kernels of every level with the scalar reference. Optional.\n"
+             << "  [--pixels N]: pixels of the benchmarked row (default: 65536). Optional.\n"
+             << "  [--repeat N]: runs of each measure, the fastest one is reported (default: 7). Optional.\n";
+        return 1;
+    }
+    return 0;
+}
@@ -0,0 +1,114 @@
+#include "simd_kernels.h"
+#include <cstring>
+#include <algorithm>
+
+#ifdef CLIM_SIMD_X86
+#ifdef _MSC_VER
+#include <intrin.h>
+#elif defined(__GNUC__) || defined(__clang__)
+#include <cpuid.h>
+#endif
+#endif
+
+const size_t SimdKernels::Escape::CAPACITY;
+
+// The best level is selected before main() (no kernel runs during static initialization)
+SimdKernels::Kernels SimdKernels::kernels = {
+    &SimdKernels::mark_changes_scalar, Level::SCALAR
+};
+static const SimdKernels::Level initial_level = SimdKernels::set_level(SimdKernels::Level::AVX2);
+
+// SSE4.1 and SSSE3 from CPUID leaf 1; AVX2 from leaf 7, if the OS saves the AVX registers (OSXSAVE, then XCR0).
+SimdKernels::Level SimdKernels::detect() {
+#ifdef CLIM_SIMD_X86
+    unsigned int registers[4] = {0, 0, 0, 0};  // eax, ebx, ecx, edx
+    unsigned int max_leaf;
+#ifdef _MSC_VER
+    int info[4];
+    __cpuid(info, 0);
+    max_leaf = static_cast<unsigned int>(info[0]);
+    __cpuid(info, 1);
+    std::memcpy(registers, info, sizeof(registers));
+#else
+    max_leaf = __get_cpuid_max(0, nullptr);
+    __cpuid(1, registers[0], registers[1], registers[2], registers[3]);
+#endif
+    bool ssse3 = registers[2] & (1u << 9), sse41 = registers[2] & (1u << 19);
+    bool osxsave = registers[2] & (1u << 27), avx = registers[2] & (1u << 28);
+    if (!ssse3 || !sse41) {
+        return Level::SCALAR;
+    }
+    if (max_leaf < 7 || !osxsave || !avx) {
+        return Level::SSE4;
+    }
+#ifdef _MSC_VER
+    unsigned long long xcr0 = _xgetbv(0);
+    __cpuidex(info, 7, 0);
+    std::memcpy(registers, info, sizeof(registers));
+#else
+    unsigned int xcr0_low, xcr0_high;
+    __asm__("xgetbv" : "=a"(xcr0_low), "=d"(xcr0_high) : "c"(0));
+    unsigned long long xcr0 = xcr0_low | static_cast<unsigned long long>(xcr0_high) << 32;
+    __cpuid_count(7, 0, registers[0], registers[1], registers[2], registers[3]);
+#endif
+    bool avx_state = (xcr0 & 0x6) == 0x6;  // XMM and YMM registers
+    bool avx2 = registers[1] & (1u << 5);
+    return avx_state && avx2 ? Level::AVX2 : Level::SSE4;
+#else
+    return Level::SCALAR;
+#endif
+}
+
+SimdKernels::Level SimdKernels::level() {
+    return kernels.level;
+}
+
+SimdKernels::Level SimdKernels::set_level(Level level) {
+    level = std::min(level, detect());
+    switch (level) {
+#ifdef CLIM_SIMD_X86
+    case Level::AVX2:
+        kernels = {&SimdKernels::mark_changes_avx2, level};
+        break;
+    case Level::SSE4:
+        kernels = {&SimdKernels::mark_changes_sse4, level};
+        break;
+#endif
+    default:
+        kernels = {&SimdKernels::mark_changes_scalar, Level::SCALAR};
+        break;
+    }
+    return kernels.level;
+}
+
+const char* SimdKernels::level_name(const Level level) {
+    switch (level) {
+    case Level::AVX2:
+        return "avx2";
+    case Level::SSE4:
+        return "sse4";
+    default:
+        return "scalar";
+    }
+}
+
+size_t SimdKernels::mark_changes_scalar(const uint8_t* pixels, const uint8_t* previous, const size_t count,
+                                        uint8_t* changes) {
+    size_t marked = 0;
+    for (size_t i = 0; i < count; ++i) {
+        changes[i] |= pixels[i] != previous[i];
+        marked += changes[i];
+    }
+    return marked;
+}
+
+char* SimdKernels::write_escapes(char* destination, const uint8_t* pixels, const size_t count,
+                                 const uint8_t* terminal_colors, const Escape* escapes, const char character) {
+    for (size_t i = 0; i < count; ++i) {
+        const Escape& escape = escapes[terminal_colors[pixels[i]]];
+        std::memcpy(destination, escape.bytes, sizeof(Escape));  // a fixed size: plain moves rather than a call
+        destination += escape.length;
+        *destination++ = character;
+    }
+    return destination;
+}
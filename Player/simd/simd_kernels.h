@@ -0,0 +1,131 @@
+#ifndef SIMD_KERNELS_H
+#define SIMD_KERNELS_H
+
+#include <cstddef>
+#include <cstdint>
+
+// x86 builds get the SSE4 and AVX2 kernels, selected at runtime; other targets only have the scalar ones
+#if defined(__x86_64__) || defined(__i386__) || defined(_M_X64) || defined(_M_IX86)
+#define CLIM_SIMD_X86
+#endif
+
+/**
+ * @class SimdKernels
+ * @brief A static utility class dispatching the byte loops of rendering to SIMD kernels.
+ *
+ * Every dispatched kernel has a scalar reference and, on x86, SSE4 and AVX2 versions. The best level supported
+ * by the CPU is selected at startup; set_level() switches to a lower one (simd_bench uses it to compare every level
+ * with the scalar reference and to time them), and must be called before any thread uses the kernels.
+ * Kernels work on a row at a time, so that the dispatch is paid once per row. Runs of pixels are not
+ * among them: std::fill_n already compiles to memset, whose C library picks a vectorized version at runtime.
+ * Neither is write_escapes: its records are copied with fixed-size moves, and wide stores were not faster.
+ */
+class SimdKernels {
+public:
+    /**
+     * @enum Level
+     * @brief Instruction sets the kernels are written for.
+     */
+    enum class Level {
+        SCALAR,	///< Plain C++ (the reference).
+        SSE4,	///< SSE4.1, 16-byte vectors.
+        AVX2	///< AVX2, 32-byte vectors.
+    };
+
+    /**
+     * @struct Escape
+     * @brief An escape code padded to a 32-byte record, copied whole with fixed-size moves (only `length` bytes are kept).
+     */
+    struct Escape {
+        static const size_t CAPACITY = 31;	///< Longest escape code ("\033[48;2;255;255;255m", 19 bytes) padded to the record.
+
+        char bytes[CAPACITY];	///< Escape code.
+        uint8_t length;			///< Length of the escape code.
+    };
+
+    /**
+     * @brief Finds the best level supported by the CPU (and the operating system, for the AVX registers).
+     * @return The level.
+     */
+    static Level detect();
+
+    /**
+     * @brief Gets the level of the kernels in use.
+     * @return The level.
+     */
+    static Level level();
+
+    /**
+     * @brief Selects the kernels of a level, or of the best supported level below it.
+     * @param level The wanted level.
+     * @return The level selected.
+     */
+    static Level set_level(Level level);
+
+    /**
+     * @brief Gets the name of a level.
+     * @param level The level.
+     * @return "scalar", "sse4" or "avx2".
+     */
+    static const char* level_name(Level level);
+
+    /**
+     * @brief Marks the pixels of a row that differ from the previous frame: `changes[i]` becomes 1 where
+     * `pixels[i] != previous[i]` and is kept otherwise, so that the rows of pixels of a cell can be marked in turn.
+     * @param pixels The palette indices of the row.
+     * @param previous The palette indices of the row in the previous frame.
+     * @param count The number of pixels.
+     * @param changes The marks (0 or 1) of the `count` cells.
+     * @return The number of marked cells.
+     */
+    static size_t mark_changes(const uint8_t* pixels, const uint8_t* previous, const size_t count, uint8_t* changes) {
+        return kernels.mark_changes(pixels, previous, count, changes);
+    }
+
+    /**
+     * @brief Writes an escape code and a character per pixel: the escape code of the terminal color of the pixel.
+     * @param destination Where to write (with room for a whole Escape record after the last character).
+     * @param pixels The palette indices.
+     * @param count The number of pixels.
+     * @param terminal_colors The terminal color of each palette index (256 entries).
+     * @param escapes The escape code of each terminal color (256 entries).
+     * @param character The character following each escape code.
+     * @return The end of the written bytes.
+     */
+    static char* write_escapes(char* destination, const uint8_t* pixels, size_t count,
+                               const uint8_t* terminal_colors, const Escape* escapes, char character);
+
+private:
+    /**
+     * @struct Kernels
+     * @brief The kernels of a level.
+     */
+    struct Kernels {
+        size_t (*mark_changes)(const uint8_t*, const uint8_t*, size_t, uint8_t*);	///< See mark_changes.
+        Level level;	///< Level of the kernels.
+    };
+
+    static Kernels kernels;	///< The kernels in use.
+
+    // Scalar references (simd_kernels.cpp)
+    static size_t mark_changes_scalar(const uint8_t* pixels, const uint8_t* previous, size_t count, uint8_t* changes);
+
+#ifdef CLIM_SIMD_X86
+    // SSE4 kernels (simd_sse4.cpp)
+    static size_t mark_changes_sse4(const uint8_t* pixels, const uint8_t* previous, size_t count, uint8_t* changes);
+
+    // AVX2 kernels (simd_avx2.cpp)
+    static size_t mark_changes_avx2(const uint8_t* pixels, const uint8_t* previous, size_t count, uint8_t* changes);
+#endif
+};
+
+static_assert(sizeof(SimdKernels::Escape) == 32, "Escape records must be 32 bytes");
+
+// Kernels with a target attribute may use the intrinsics of their level, the rest of the program stays baseline
+#if defined(CLIM_SIMD_X86) && (defined(__GNUC__) || defined(__clang__))
+#define CLIM_TARGET(instructions) __attribute__((target(instructions)))
+#else
+#define CLIM_TARGET(instructions)
+#endif
+
+#endif	// SIMD_KERNELS_H
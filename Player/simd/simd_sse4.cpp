@@ -0,0 +1,29 @@
+#include "simd_kernels.h"
+
+#ifdef CLIM_SIMD_X86
+
+#include <smmintrin.h>  // SSE4.1 (and SSSE3 through it)
+
+// 16 pixels per step: the bytes that differ become 1 and are or-ed into the marks, which are summed 8 at a time
+// (sum of absolute differences with 0) into two 64-bit counters. The last pixels (less than 16) are marked one at a time.
+CLIM_TARGET("sse4.1")
+size_t SimdKernels::mark_changes_sse4(const uint8_t* pixels, const uint8_t* previous, const size_t count,
+                                      uint8_t* changes) {
+    const __m128i one = _mm_set1_epi8(1), zero = _mm_setzero_si128();
+    __m128i sums = zero;
+    size_t i = 0;
+    for (; i + 16 <= count; i += 16) {
+        __m128i equal = _mm_cmpeq_epi8(_mm_loadu_si128(reinterpret_cast<const __m128i*>(pixels + i)),
+                                       _mm_loadu_si128(reinterpret_cast<const __m128i*>(previous + i)));
+        __m128i* marks = reinterpret_cast<__m128i*>(changes + i);
+        __m128i marked = _mm_or_si128(_mm_loadu_si128(marks), _mm_andnot_si128(equal, one));
+        _mm_storeu_si128(marks, marked);
+        sums = _mm_add_epi64(sums, _mm_sad_epu8(marked, zero));
+    }
+    uint64_t counters[2];
+    _mm_storeu_si128(reinterpret_cast<__m128i*>(counters), sums);
+    size_t marked = static_cast<size_t>(counters[0] + counters[1]);
+    return marked + mark_changes_scalar(pixels + i, previous + i, count - i, changes + i);
+}
+
+#endif	// CLIM_SIMD_X86
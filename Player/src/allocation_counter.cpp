@@ -0,0 +1,53 @@
+#include "allocation_counter.h"
+
+#ifdef CLIM_DEBUG_ALLOCATIONS
+
+#include <new>
+#include <atomic>
+#include <cstdlib>
+
+// Global counter of allocations (relaxed: only the total matters)
+static std::atomic<size_t> allocations(0);
+
+// Counting replacements of the global allocation functions (arrays and nothrow versions use these by default)
+
+void* operator new(size_t size) {
+    allocations.fetch_add(1, std::memory_order_relaxed);
+    void* pointer = std::malloc(size ? size : 1);
+    if (!pointer) {
+        throw std::bad_alloc();
+    }
+    return pointer;
+}
+
+void* operator new[](size_t size) {
+    return operator new(size);
+}
+
+void operator delete(void* pointer) noexcept {
+    std::free(pointer);
+}
+
+void operator delete[](void* pointer) noexcept {
+    std::free(pointer);
+}
+
+bool AllocationCounter::enabled() {
+    return true;
+}
+
+size_t AllocationCounter::count() {
+    return allocations.load(std::memory_order_relaxed);
+}
+
+#else
+
+bool AllocationCounter::enabled() {
+    return false;
+}
+
+size_t AllocationCounter::count() {
+    return 0;
+}
+
+#endif
@@ -114,8 +114,7 @@ void AudioPlayer::execute_ffplay() {
         ffplay_handle = nullptr; // Reset the handle.
 
 #else
-        // Create the ffplay command for POSIX systems.
-        command = "ffplay -nodisp -loglevel quiet -autoexit \"" + temp_file_path + "\"";
+        // Fork and execute ffplay (arguments are passed directly: no command string to build)
         ffplay_pid = fork(); // Fork the current process.
 
         if (ffplay_pid == 0) {
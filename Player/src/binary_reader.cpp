@@ -1,11 +1,32 @@
 #include "binary_reader.h"
+#include <algorithm>
 
-void BinaryReader::setup(const std::string& file_path, size_t chunk_size, size_t overlap_size) {
+#ifdef _WIN32
+#define NOMINMAX
+#include <windows.h>
+#else
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+BinaryReader::BinaryReader(const std::string& file_path, size_t chunk_size, size_t overlap_size, bool memory_map) {
+    setup(file_path, chunk_size, overlap_size, memory_map);
+}
+
+void BinaryReader::setup(const std::string& file_path, size_t chunk_size, size_t overlap_size, bool memory_map) {
     // member initializers
 	this->file_path = file_path;
 	this->chunk_size = chunk_size;
 	this->overlap_size = overlap_size;
-    
+
+    // Prefer the zero-copy memory mapping: no chunk will ever be loaded
+    unmap_file();
+    if (memory_map && map_file()) {
+        return;
+    }
+
     // Open the file stream
     file_stream.open(file_path, std::ios::binary | std::ios::ate);
     if (!file_stream.is_open()) {
@@ -22,11 +43,87 @@ void BinaryReader::setup(const std::string& file_path, size_t chunk_size, size_t
 }
 
 BinaryReader::~BinaryReader() {
+    unmap_file();
     if (file_stream.is_open()) {
         file_stream.close();
     }
 }
 
+bool BinaryReader::map_file() {
+#ifdef _WIN32
+    HANDLE file = CreateFileA(file_path.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr,
+                              OPEN_EXISTING, FILE_FLAG_SEQUENTIAL_SCAN, nullptr);
+    if (file == INVALID_HANDLE_VALUE) {
+        return false;
+    }
+    LARGE_INTEGER size;
+    if (!GetFileSizeEx(file, &size) || size.QuadPart == 0) {  // empty files cannot be mapped
+        CloseHandle(file);
+        return false;
+    }
+    HANDLE mapping = CreateFileMappingA(file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+    void* view = mapping ? MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0) : nullptr;
+    // The view keeps the mapping alive on its own
+    if (mapping) {
+        CloseHandle(mapping);
+    }
+    CloseHandle(file);
+    if (!view) {
+        return false;
+    }
+    file_size = static_cast<size_t>(size.QuadPart);
+#else
+    int fd = open(file_path.c_str(), O_RDONLY);
+    if (fd < 0) {
+        return false;
+    }
+    struct stat file_stat;
+    if (fstat(fd, &file_stat) != 0 || file_stat.st_size == 0) {  // empty files cannot be mapped
+        close(fd);
+        return false;
+    }
+    void* view = mmap(nullptr, static_cast<size_t>(file_stat.st_size), PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);  // the mapping keeps the file referenced on its own
+    if (view == MAP_FAILED) {
+        return false;
+    }
+    file_size = static_cast<size_t>(file_stat.st_size);
+    // Frames are decoded front to back: read ahead aggressively, starting with the headers
+    madvise(view, file_size, MADV_SEQUENTIAL);
+#endif
+    mapped_data = static_cast<const uint8_t*>(view);
+    prefetch(0, chunk_size);
+    return true;
+}
+
+void BinaryReader::unmap_file() {
+    if (!mapped_data) {
+        return;
+    }
+#ifdef _WIN32
+    UnmapViewOfFile(mapped_data);
+#else
+    munmap(const_cast<uint8_t*>(mapped_data), file_size);
+#endif
+    mapped_data = nullptr;
+}
+
+void BinaryReader::prefetch(size_t index, size_t length) const {
+#ifndef _WIN32
+    if (!mapped_data || index >= file_size) {
+        return;
+    }
+    // madvise requires a page-aligned start address
+    size_t page_size = static_cast<size_t>(sysconf(_SC_PAGESIZE));
+    size_t start = index - index % page_size;
+    length = std::min(length + (index - start), file_size - start);
+    madvise(const_cast<uint8_t*>(mapped_data) + start, length, MADV_WILLNEED);
+#else
+    (void)index;
+    (void)length;
+#endif
+}
+
 void BinaryReader::load_chunk(size_t start_index) {
     if (start_index >= file_size) {
         throw std::out_of_range("Start index exceeds file size");
@@ -46,6 +143,14 @@ void BinaryReader::load_chunk(size_t start_index) {
 }
 
 uint8_t BinaryReader::get_byte(size_t index) {
+    // The whole file is already in memory if mapped
+    if (mapped_data) {
+        if (index >= file_size) {
+            throw std::out_of_range("Index exceeds file size");
+        }
+        return mapped_data[index];
+    }
+
     // Check if the requested byte is outside the current chunk
     if (index < current_file_index || index >= current_file_index + buffer.size()) {
         // Calculate the start of the new chunk
@@ -59,7 +164,24 @@ uint8_t BinaryReader::get_byte(size_t index) {
     return buffer[index - current_file_index];
 }
 
+const uint8_t* BinaryReader::get_span(size_t index, size_t& available) {
+    if (index >= file_size) {
+        available = 0;
+        return nullptr;
+    }
+
+    // The mapped span covers the whole file
+    if (mapped_data) {
+        available = file_size - index;
+        return mapped_data + index;
+    }
+
+    // Make the requested byte part of the current chunk, then expose the rest of the chunk
+    get_byte(index);
+    available = std::min(buffer.size(), file_size - current_file_index) - (index - current_file_index);
+    return buffer.data() + (index - current_file_index);
+}
+
 size_t BinaryReader::size() const {
     return file_size;
 }
-
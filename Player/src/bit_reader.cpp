@@ -1,10 +1,55 @@
 #include "bit_reader.h"
-#include <stdexcept>
+#include <algorithm>
+
+const size_t BitReader::MAX_PEEK_BITS;
 
 // Constructor initializes the bit reader with a reference to the data reader
 // and the starting bit index.
 BitReader::BitReader(BinaryReader& _data_reader, const size_t next_bit_index)
-    : data_reader(_data_reader), byte_index(next_bit_index / 8), bit_index(next_bit_index % 8) {}
+    : data_reader(_data_reader), next_byte_index(next_bit_index / 8) {
+    // Skip the bits already read in the starting byte
+    size_t skipped_bits = next_bit_index % 8;
+    if (skipped_bits) {
+        refill();
+        skipped_bits = std::min(skipped_bits, buffered_bits);
+        bit_buffer <<= skipped_bits;
+        buffered_bits -= skipped_bits;
+    }
+}
+
+// Loads as many whole bytes as fit into the bit buffer, from the contiguous span of the data reader.
+void BitReader::refill() {
+    size_t bytes_to_load = (64 - buffered_bits) / 8;
+    if (bytes_to_load == 0) {
+        return;
+    }
+
+    // A chunked span may be replaced by any other access to the reader: only a mapped one can be kept
+    if (span_available == 0 || !data_reader.is_memory_mapped()) {
+        span = data_reader.get_span(next_byte_index, span_available);
+    }
+
+    // Append the bytes right after the buffered bits (MSB-first).
+    uint64_t word = 0;
+    if (span_available >= 8) {
+        for (size_t i = 0; i < 8; ++i) {  // big-endian 64-bit load
+            word = (word << 8) | span[i];
+        }
+        word &= ~static_cast<uint64_t>(0) << (64 - 8 * bytes_to_load);
+    } else {
+        bytes_to_load = std::min(bytes_to_load, span_available);
+        for (size_t i = 0; i < bytes_to_load; ++i) {
+            word = (word << 8) | span[i];
+        }
+        word = bytes_to_load ? word << (64 - 8 * bytes_to_load) : 0;
+    }
+    bit_buffer |= word >> buffered_bits;
+
+    buffered_bits += 8 * bytes_to_load;
+    next_byte_index += bytes_to_load;
+    span += bytes_to_load;
+    span_available -= bytes_to_load;
+}
 
 // Reads the next `n` bits and returns them as a 64-bit unsigned integer.
 uint64_t BitReader::read_bits(size_t n) {
@@ -14,17 +59,13 @@ uint64_t BitReader::read_bits(size_t n) {
 
     uint64_t result = 0;
 
-    // Loop to read `n` bits one at a time.
-    for (size_t i = 0; i < n; ++i) {
-        if (is_at_end()) {
-            throw std::out_of_range("Attempt to read beyond the end of the data.");
-        }
-
-        // Extract the next bit and shift it into the result.
-        result = (result << 1) | ((data_reader.get_byte(byte_index) >> (7 - bit_index)) & 1);
-
-        // Move to the next bit in the data.
-        increment_bit_index();
+    // Read at most MAX_PEEK_BITS bits at a time.
+    while (n > 0) {
+        size_t step = std::min(n, MAX_PEEK_BITS);
+        uint64_t bits = peek(step);
+        consume(step);  // throws if reading beyond the end of the data
+        result = (step < 64 ? result << step : 0) | bits;
+        n -= step;
     }
 
     return result;
@@ -32,30 +73,18 @@ uint64_t BitReader::read_bits(size_t n) {
 
 // Reads a single bit and returns it as a boolean.
 bool BitReader::read_bit_bool() {
-    // Extract the current bit as a boolean value.
-    bool result = ((data_reader.get_byte(byte_index) >> (7 - bit_index)) & 1);
-
-    // Move to the next bit.
-    increment_bit_index();
-    return result;
+    return read_bits(1) != 0;
 }
 
 // Reads `n` bits and returns them as a string of '0' and '1'.
 std::string BitReader::read_bit_string(size_t n) {
     std::string bit_string;
+    bit_string.reserve(n);
 
     // Loop to read `n` bits one at a time.
     for (size_t i = 0; i < n; ++i) {
-        if (is_at_end()) {
-            throw std::out_of_range("Attempt to read beyond the end of the data.");
-        }
-
         // Append '1' or '0' to the string based on the current bit value.
-        char bit = ((data_reader.get_byte(byte_index) >> (7 - bit_index)) & 1) ? '1' : '0';
-        bit_string.push_back(bit);
-
-        // Move to the next bit.
-        increment_bit_index();
+        bit_string.push_back(read_bits(1) ? '1' : '0');
     }
 
     return bit_string;  // Return the constructed string of bits.
@@ -63,16 +92,14 @@ std::string BitReader::read_bit_string(size_t n) {
 
 // Aligns the bit reader to the next byte boundary and returns the updated byte index.
 size_t BitReader::align_to_byte() {
-    if ((bit_index % 8) != 0) {
-        // Move to the next byte if the bit index is not aligned.
-        bit_index = 0;
-        byte_index++;
-    }
-    return byte_index;
+    // The buffer always ends on a byte boundary: drop the bits left in the current byte.
+    size_t partial_bits = buffered_bits % 8;
+    bit_buffer <<= partial_bits;
+    buffered_bits -= partial_bits;
+    return next_byte_index - buffered_bits / 8;
 }
 
 // Checks if the bit reader has reached the end of the data.
 bool BitReader::is_at_end() const {
-    return byte_index >= data_reader.size();  // True if the byte index exceeds the data size.
+    return next_byte_index * 8 - buffered_bits >= data_reader.size() * 8;  // True if the bit index exceeds the data size.
 }
-
@@ -4,10 +4,12 @@
 #include <iostream>
 #include <fstream>
 #include <stdexcept>
+#include <algorithm>
 
 CLIMDecoder::CLIMDecoder(const std::string& file_path, const std::string& audio_extraction_folder)
     : file_path(file_path), audio_extraction_folder(audio_extraction_folder), next_byte_index(0),
-	current_cluster_index(0), cluster_starting_frame(0) {
+	saved_indexed_clusters(0), current_cluster_index(0), cluster_starting_frame(0), cluster_decoded_frames(0),
+    max_frames_ahead(0), frames_ahead(0), next_submitted_cluster(0) {
     try {
         // Setup the reader of the binary file
         encoded_file_reader.setup(file_path, (1 << 16), (1 << 8));
@@ -52,6 +54,14 @@ CLIMDecoder::CLIMDecoder(const std::string& file_path, const std::string& audio_
         decode_clustering_header();
         // Save current index as the start of clusters
         first_cluster_starting_byte_index = next_byte_index;
+        cluster_starting_bytes.reserve(total_clusters);
+        // Reuse the cluster index of previous runs, if still valid (otherwise it will be rebuilt while decoding)
+        size_t extension_index = file_path.rfind(".clim");
+        index_filepath = (extension_index != std::string::npos && extension_index + 5 == file_path.size()
+                          ? file_path.substr(0, extension_index) : file_path) + INDEX_EXTENSION;
+        if (!load_index()) {
+            index_cluster(0, first_cluster_starting_byte_index);
+        }
     } catch (const std::exception& e) {
         std::cerr << "Error during initialization: " << e.what() << "\n";
         throw;  // Rethrow exception for caller to handle
@@ -60,6 +70,11 @@ CLIMDecoder::CLIMDecoder(const std::string& file_path, const std::string& audio_
 
 CLIMDecoder::~CLIMDecoder() {
 	namespace fs = std::filesystem;
+	workers.stop();  // the workers may still be scanning the file
+	// keep the clusters found during this run for the next ones
+	if (cluster_starting_bytes.size() > saved_indexed_clusters) {
+		save_index();
+	}
 	// delete created audio file
 	if (!fs::delete_file(audio_extraxtion_filepath)) {
 		std::cerr << "unable to delete the audio file: " + audio_extraxtion_filepath;
@@ -110,11 +125,16 @@ void CLIMDecoder::decode_clustering_header() {
 
     // Read the dimensions of each cluster and calculate total frames from cluster dimensions
     total_frames = 0;
+    max_cluster_frames = 0;
     cluster_dimensions = std::vector<size_t>(total_clusters);
+    cluster_starting_frames = std::vector<size_t>(total_clusters + 1);
     for (size_t i = 0; i < total_clusters; ++i) {
         cluster_dimensions[i] = reader.read_bits(max_clusters_dimensions_binary_length) + 1;
+        cluster_starting_frames[i] = total_frames;
         total_frames += cluster_dimensions[i];
+        max_cluster_frames = std::max(max_cluster_frames, cluster_dimensions[i]);
     }
+    cluster_starting_frames[total_clusters] = total_frames;
 
     // Align to byte (and save at which bit index to start considering the content after the header)
     next_byte_index = reader.align_to_byte();
@@ -145,10 +165,11 @@ void CLIMDecoder::extract_audio() {
     // Extract and write audio data to the output file
     size_t index_byte_audio = info.index_first_byte_audio;
     while (index_byte_audio < encoded_file_reader.size()) {
-        // Retrieve a byte from the encoded file reader and write it to the audio file
-        char byte = encoded_file_reader.get_byte(index_byte_audio);
-        audio_file.put(byte);
-        index_byte_audio++;
+        // Retrieve the contiguous bytes available from the encoded file reader and write them to the audio file
+        size_t available = 0;
+        const uint8_t* bytes = encoded_file_reader.get_span(index_byte_audio, available);
+        audio_file.write(reinterpret_cast<const char*>(bytes), available);
+        index_byte_audio += available;
     }
 
     // Close the file after writing
@@ -160,18 +181,47 @@ void CLIMDecoder::extract_audio() {
 }
 
 
-bool CLIMDecoder::get_next_cluster_frames(std::vector<Frame>& frames) {
+bool CLIMDecoder::next_frame(FrameHandle& frame, FramePool& pool) {
     if (current_cluster_index >= total_clusters) {
         return false;
     }
 
     try {
-        frames = cluster_decoder.decode_cluster(encoded_file_reader, next_byte_index, cluster_dimensions[current_cluster_index]);
-        // Move to the next cluster
-		cluster_starting_frame += cluster_dimensions[current_cluster_index];  // update starting frame index
-		current_cluster_index++;  // update cluster index
+        // Entering a cluster: take it from the workers, or decode its palette, shared by the frames decoded
+        // until the end of the cluster
+        if (cluster_decoded_frames == 0) {
+            if (workers.running()) {
+                schedule_clusters(pool);
+            }
+            if (workers.running() && workers.is_next(current_cluster_index)) {
+                workers.take(cluster_frames, next_byte_index);
+            } else {
+                cluster_colors = pool.acquire_palette();
+                cluster_decoder.decode_palette(encoded_file_reader, next_byte_index, *cluster_colors);
+            }
+        }
+        if (!cluster_frames.empty()) {
+            frame = std::move(cluster_frames[cluster_decoded_frames]);
+        } else {
+            frame = pool.acquire();
+            cluster_decoder.decode_frame(encoded_file_reader, next_byte_index, *frame);
+            frame->palette = cluster_colors;
+        }
+        // Move to the next cluster after its last frame
+        if (++cluster_decoded_frames == cluster_dimensions[current_cluster_index]) {
+            if (!cluster_frames.empty()) {
+                frames_ahead -= cluster_dimensions[current_cluster_index];  // the frames taken from the workers are out
+                cluster_frames.clear();
+            }
+            cluster_colors.reset();  // the pool can reuse the palette once the frames are released
+            cluster_decoded_frames = 0;
+            cluster_starting_frame += cluster_dimensions[current_cluster_index];  // update starting frame index
+            current_cluster_index++;  // update cluster index
+            index_cluster(current_cluster_index, next_byte_index);  // the next cluster starts where this one ended
+        }
     } catch (const std::exception& e) {
-        std::cerr << "Error while decoding cluster: " << e.what() << "\n";
+        std::cerr << "Error while decoding frame with index " << cluster_starting_frame + cluster_decoded_frames
+                  << ": " << e.what() << "\n";
         throw;  // Rethrow exception for caller to handle
     }
 
@@ -179,6 +229,176 @@ bool CLIMDecoder::get_next_cluster_frames(std::vector<Frame>& frames) {
 }
 
 
+void CLIMDecoder::set_decoding_threads(const size_t threads, const size_t max_frames_ahead) {
+    // Frames of the clusters given to the previous workers are dropped: restart from the current cluster
+    workers.stop();
+    cluster_frames.clear();
+    if (cluster_decoded_frames > 0) {
+        set_cluster_for_frame(cluster_starting_frame);
+    }
+    frames_ahead = 0;
+    next_submitted_cluster = 0;
+    this->max_frames_ahead = max_frames_ahead;
+    if (threads > 1 && max_frames_ahead > 0) {
+        cluster_frames.reserve(max_frames_ahead);
+        workers.start(file_path, info.width, info.height, cluster_dimensions, threads - 1, max_frames_ahead);
+    }
+}
+
+void CLIMDecoder::schedule_clusters(FramePool& pool) {
+    // Record the boundaries found by the scan
+    size_t byte_index;
+    while (cluster_starting_bytes.size() < total_clusters && workers.scanned(cluster_starting_bytes.size(), byte_index)) {
+        index_cluster(cluster_starting_bytes.size(), byte_index);
+    }
+
+    // Give the workers the clusters following the current one (left to next_frame if larger than the frames ahead),
+    // as far as their first byte is known
+    next_submitted_cluster = std::max(next_submitted_cluster, current_cluster_index + 1);
+    while (next_submitted_cluster < cluster_starting_bytes.size() && workers.can_submit()) {
+        size_t frames = cluster_dimensions[next_submitted_cluster];
+        if (frames > max_frames_ahead) {
+            next_submitted_cluster++;
+            continue;
+        }
+        if (frames_ahead + frames > max_frames_ahead) {
+            break;
+        }
+        workers.submit(next_submitted_cluster, cluster_starting_bytes[next_submitted_cluster], pool.acquire_palette(), pool);
+        frames_ahead += frames;
+        next_submitted_cluster++;
+    }
+
+    // Scan from the last known boundary up to the clusters the workers could take next
+    size_t end_cluster = std::upper_bound(cluster_starting_frames.begin(), cluster_starting_frames.end(),
+                                          cluster_starting_frame + max_frames_ahead) - cluster_starting_frames.begin();
+    end_cluster = std::min(end_cluster, total_clusters - 1);
+    if (cluster_starting_bytes.size() <= end_cluster) {
+        workers.scan(cluster_starting_bytes.size() - 1, cluster_starting_bytes.back(), end_cluster);
+    }
+}
+
+
+void CLIMDecoder::index_cluster(const size_t cluster_index, const size_t byte_index) {
+    if (cluster_index == cluster_starting_bytes.size() && cluster_index < total_clusters) {
+        cluster_starting_bytes.push_back(byte_index);
+        // save the index as soon as it is complete
+        if (cluster_starting_bytes.size() == total_clusters) {
+            save_index();
+        }
+    }
+}
+
+
+/* Sidecar index file (all integers are 64-bit little-endian):
+	magic:		"CLIMIDX2" (8 B) |
+	key:		file size | last modification time (ns) | hash of the headers |
+	count:		number of indexed clusters (N) |
+	offsets:	first byte index of cluster0 | cluster1 | ... | clusterN-1 |
+*/
+static const char INDEX_MAGIC[8] = {'C', 'L', 'I', 'M', 'I', 'D', 'X', '2'};  // 1: modification time in seconds
+
+// Writes a 64-bit integer in little-endian order.
+static void write_uint64(std::ostream& os, uint64_t value) {
+    char bytes[8];
+    for (size_t i = 0; i < 8; ++i) {
+        bytes[i] = static_cast<char>((value >> (8 * i)) & 0xFF);
+    }
+    os.write(bytes, 8);
+}
+
+// Reads a 64-bit integer in little-endian order (0 if the stream fails).
+static uint64_t read_uint64(std::istream& is) {
+    unsigned char bytes[8] = {0};
+    is.read(reinterpret_cast<char*>(bytes), 8);
+    uint64_t value = 0;
+    for (size_t i = 8; i-- > 0;) {
+        value = (value << 8) | bytes[i];
+    }
+    return value;
+}
+
+void CLIMDecoder::compute_index_key(uint64_t& file_size, uint64_t& modification_time, uint64_t& header_hash) {
+    file_size = encoded_file_reader.size();
+    modification_time = static_cast<uint64_t>(std::filesystem::last_write_time(file_path));
+
+    // FNV-1a over the headers: any change to the clusters layout changes the clustering header
+    header_hash = 14695981039346656037ULL;
+    size_t index = 0;
+    while (index < first_cluster_starting_byte_index) {
+        size_t available = 0;
+        const uint8_t* bytes = encoded_file_reader.get_span(index, available);
+        available = std::min(available, first_cluster_starting_byte_index - index);
+        for (size_t i = 0; i < available; ++i) {
+            header_hash = (header_hash ^ bytes[i]) * 1099511628211ULL;
+        }
+        index += available;
+    }
+}
+
+bool CLIMDecoder::load_index() {
+    std::ifstream index_file(index_filepath, std::ios::binary);
+    if (!index_file.is_open()) {
+        return false;
+    }
+
+    // Check that the index has been built for the current content of the file
+    char magic[8] = {0};
+    index_file.read(magic, 8);
+    uint64_t file_size, modification_time, header_hash;
+    compute_index_key(file_size, modification_time, header_hash);
+    if (!std::equal(magic, magic + 8, INDEX_MAGIC)
+        || read_uint64(index_file) != file_size
+        || read_uint64(index_file) != modification_time
+        || read_uint64(index_file) != header_hash) {
+        return false;  // stale: it will be rebuilt
+    }
+
+    // Read the offsets, checking that they are ordered and point within the video data
+    uint64_t count = read_uint64(index_file);
+    if (count == 0 || count > total_clusters) {
+        return false;
+    }
+    std::vector<size_t> offsets(count);
+    for (size_t i = 0; i < count; ++i) {
+        offsets[i] = read_uint64(index_file);
+        if (!index_file || offsets[i] < (i ? offsets[i - 1] : first_cluster_starting_byte_index)
+            || offsets[i] >= info.index_first_byte_audio) {
+            return false;
+        }
+    }
+    if (offsets[0] != first_cluster_starting_byte_index) {
+        return false;
+    }
+
+    cluster_starting_bytes.assign(offsets.begin(), offsets.end());
+    saved_indexed_clusters = count;
+    return true;
+}
+
+void CLIMDecoder::save_index() {
+    uint64_t file_size, modification_time, header_hash;
+    compute_index_key(file_size, modification_time, header_hash);
+
+    std::ofstream index_file(index_filepath, std::ios::binary | std::ios::trunc);
+    if (!index_file.is_open()) {
+        return;  // e.g. read-only folder: the index will just be rebuilt next time
+    }
+    index_file.write(INDEX_MAGIC, 8);
+    write_uint64(index_file, file_size);
+    write_uint64(index_file, modification_time);
+    write_uint64(index_file, header_hash);
+    write_uint64(index_file, cluster_starting_bytes.size());
+    for (size_t offset : cluster_starting_bytes) {
+        write_uint64(index_file, offset);
+    }
+    index_file.close();
+    if (index_file) {
+        saved_indexed_clusters = cluster_starting_bytes.size();
+    }
+}
+
+
 // Reset to desired frame index the next extraction
 bool CLIMDecoder::set_cluster_for_frame(const size_t frame_index) {
     if (frame_index >= total_frames) {
@@ -186,16 +406,35 @@ bool CLIMDecoder::set_cluster_for_frame(const size_t frame_index) {
     }
     
     try {
-    	size_t byte_index = first_cluster_starting_byte_index;
-	    // retrieve cluster index and relative frame to the cluster
-	    cluster_starting_frame = 0;
-	    current_cluster_index = 0;
-	    while (cluster_starting_frame + cluster_dimensions[current_cluster_index] < frame_index) {
-	    	cluster_decoder.pass_cluster(encoded_file_reader, byte_index, cluster_dimensions[current_cluster_index]);
-	    	cluster_starting_frame += cluster_dimensions[current_cluster_index];
-	    	current_cluster_index++;
-		}
-		next_byte_index = byte_index;
+        // the clusters given to the workers are not the next ones anymore
+        if (workers.running()) {
+            workers.cancel();
+            cluster_frames.clear();
+            frames_ahead = 0;
+            next_submitted_cluster = 0;
+        }
+
+        // retrieve the cluster containing the frame (the last one starting at or before it)
+        size_t target_cluster_index = std::upper_bound(cluster_starting_frames.begin(), cluster_starting_frames.end(),
+                                                       frame_index) - cluster_starting_frames.begin() - 1;
+        
+        // jump to the closest indexed cluster, then skip (and index) the ones up to the target
+        current_cluster_index = std::min(target_cluster_index, cluster_starting_bytes.size() - 1);
+        size_t byte_index = cluster_starting_bytes[current_cluster_index];
+        while (current_cluster_index < target_cluster_index) {
+            cluster_decoder.pass_cluster(encoded_file_reader, byte_index, cluster_dimensions[current_cluster_index]);
+            current_cluster_index++;
+            index_cluster(current_cluster_index, byte_index);
+        }
+        cluster_starting_frame = cluster_starting_frames[current_cluster_index];
+        next_byte_index = byte_index;
+        cluster_decoded_frames = 0;  // the target cluster is decoded from its palette again
+        cluster_colors.reset();
+        
+        // the target cluster is going to be decoded: load it ahead if its extent is known
+        if (current_cluster_index + 1 < cluster_starting_bytes.size()) {
+            encoded_file_reader.prefetch(next_byte_index, cluster_starting_bytes[current_cluster_index + 1] - next_byte_index);
+        }
     } catch (const std::exception& e) {
         std::cerr << "Error while retrieving cluster for frame with index " << frame_index << ": " << e.what() << "\n";
         throw;  // Rethrow exception for caller to handle
@@ -203,4 +442,3 @@ bool CLIMDecoder::set_cluster_for_frame(const size_t frame_index) {
 	
 	return true;
 }
-
@@ -1,22 +1,46 @@
 #include "clim_player.h"
 #include "exit_handler.h"
 #include <iostream>
-#include <thread>  // For std::this_thread::sleep_for
+#include <algorithm>
+#include <thread>
 
-CLIMPlayer::CLIMPlayer(const std::string& root_folder, const std::string& file_path_from_root)
+const size_t CLIMPlayer::CATCH_UP_LIMIT_MS;
+const size_t CLIMPlayer::WRITE_TIME_SMOOTHING;
+const size_t PlaybackStats::MAX_ADAPTATIONS;
+
+CLIMPlayer::CLIMPlayer(const std::string& root_folder, const std::string& file_path_from_root,
+                       const PlayerOptions& options)
     : decoder(root_folder + file_path_from_root) {
     // Retreive information from decoder
     StandardFormatInfo info = decoder.get_info();
     width = info.width;
     height = info.height;
     frame_time_ms = info.milliseconds_between_frames;
+    late_policy = options.late_policy;
+    adapt_output = options.adapt_output;
+    pacer = FramePacer(std::chrono::milliseconds(frame_time_ms), std::chrono::microseconds(options.spin_us));
     // Setup utils
     fps = info.fps();  // Get calculated frames per second
-    buffer_threshold = 2 * fps;  // Trigger when fewer than 2 FPS frames remain
-    renderer = FrameRenderer(width, height);  // setup frame renderer
+    renderer = FrameRenderer(width, height, options.render);  // setup frame renderer
+    // Setup the decoded frames queue: frames first, then bytes, then 4 seconds of video by default
+    size_t buffer_frames = options.buffer_frames;
+    if (buffer_frames == 0 && options.buffer_bytes > 0) {
+        buffer_frames = options.buffer_bytes / std::max<size_t>(1, width * height * sizeof(uint8_t));  // a palette index per pixel
+    } else if (buffer_frames == 0) {
+        buffer_frames = static_cast<size_t>(4 * fps);
+    }
+    frame_queue.reset(std::max<size_t>(1, buffer_frames));
+    // Setup the decoding threads: the workers decode up to a queue of frames ahead
+    size_t decode_threads = options.decode_threads ? options.decode_threads
+                                                   : std::max<size_t>(1, std::thread::hardware_concurrency());
+    size_t frames_ahead = decode_threads > 1 ? frame_queue.capacity() : 0;
+    decoder.set_decoding_threads(decode_threads, frames_ahead);
+    // Setup the frames pool: the queue, the frames decoded ahead, the frame being decoded and the frame being displayed
+    frame_pool.setup(width, height, frame_queue.capacity() + frames_ahead + 2);
     // Setup audio player. Note: decoder has already extracted audio when previously initialized
-    music = AudioPlayer(decoder.get_audio_extraxtion_filepath());  
-    // Add the player destructor as a function to be executed at the end of the program
+    music = AudioPlayer(decoder.get_audio_extraxtion_filepath());
+    // Add the player destructor as a function to be executed if the program is killed (on signals, the playback
+    // stops and the destructor runs normally: it joins the decoding thread, which a signal handler cannot do)
     destructor_fid = ExitHandler::add_cleanup_function([this]() {
         this->~CLIMPlayer();
     });
@@ -24,75 +48,225 @@ CLIMPlayer::CLIMPlayer(const std::string& root_folder, const std::string& file_p
 
 CLIMPlayer::~CLIMPlayer() {
 	ExitHandler::remove_cleanup_function(destructor_fid);  // do not call this function anymore at the end of the program (already destroyed)
+	stop_decoding();  // stop decoding before the decoder is destroyed
 	music.stop_audio();  // first: stop audio, to ensure ability to delete audio file
 	// then: default call to all the destructors for CLIMPlayer instances
 }
 
-bool CLIMPlayer::fetch_next_frames() {
-    // Fetch the next cluster of frames from the decoder
-    std::vector<Frame> new_frames;
-    bool fetched_frames = decoder.get_next_cluster_frames(new_frames);
-    if (fetched_frames) {
-        frame_buffer.insert(frame_buffer.end(), new_frames.begin(), new_frames.end());
+void CLIMPlayer::decode_frames() {
+    try {
+        // Decode frame after frame, handing each one to the rendering loop
+        FrameHandle frame;
+        while (!stop_requested && decoder.next_frame(frame, frame_pool)) {
+            while (!frame_queue.try_push(std::move(frame))) {
+                if (stop_requested) {
+                    break;
+                }
+                // The queue is full: wait for the rendering loop to take some frames (or for a stop request)
+                frame_queue.wait([this]() {
+                    return frame_queue.size() < frame_queue.capacity() || stop_requested;
+                });
+            }
+        }
+    } catch (...) {
+        decoding_error = std::current_exception();  // rethrown by the rendering loop
     }
-    return fetched_frames;
+    decoding_finished.store(true, std::memory_order_release);
+    frame_queue.notify();  // the rendering loop may be waiting for a frame
 }
 
-void CLIMPlayer::play_clim(std::ostream& outs) {
-    using namespace std::chrono;
-    
-    bool all_read = false;
-    // populate initial buffer upto 2 buffer thresholds
-    while ((!all_read) && (frame_buffer.size() <= 2 * buffer_threshold)) {
-        all_read = all_read || (!fetch_next_frames());
+void CLIMPlayer::start_decoding() {
+    stop_decoding();
+    stop_requested = false;
+    decoding_finished = false;
+    decoding_error = nullptr;
+    decoding_thread = std::thread(&CLIMPlayer::decode_frames, this);
+}
+
+void CLIMPlayer::stop_decoding() {
+    stop_requested = true;
+    frame_queue.notify();  // the decoding thread may be waiting for room in the queue
+    if (decoding_thread.joinable()) {
+        decoding_thread.join();
     }
+}
+
+bool CLIMPlayer::next_frame(FrameHandle& frame) {
+    bool late = false;
+    while (true) {
+        // Read the flag before the queue: if decoding was finished, an empty queue is the end of the video
+        bool finished = decoding_finished.load(std::memory_order_acquire);
+        if (frame_queue.try_pop(frame)) {
+            stats.underruns += late ? 1 : 0;
+            return true;
+        }
+        if (finished) {
+            if (decoding_error) {
+                std::rethrow_exception(decoding_error);
+            }
+            return false;
+        }
+        // Underrun: the decoding thread is behind, wait for it
+        late = true;
+        frame_queue.wait([this]() {
+            return frame_queue.size() > 0 || decoding_finished.load(std::memory_order_acquire);
+        });
+    }
+}
+
+void CLIMPlayer::play_clim(OutputSink& output) {
+    using namespace std::chrono;
+
+    // start decoding and wait for the queue to fill up (or for the whole video to be decoded)
+    start_decoding();
+    renderer.reset();  // the first frame is drawn in full (the screen may show anything)
+    frame_queue.wait([this]() {
+        return frame_queue.size() == frame_queue.capacity() || decoding_finished.load(std::memory_order_acquire);
+    });
+
+    auto start_time = steady_clock::now();  // Initial playback loop time: deadline of the first frame
+    pacer.start(start_time);
+    auto frame_time = pacer.get_period();
+    double frame_ms = duration<double, std::milli>(frame_time).count();
+    // Delay after which a frame is dropped rather than displayed (never for slow motion)
+    auto drop_delay = late_policy == LatePolicy::ADAPTIVE
+                      ? std::max<steady_clock::duration>(frame_time, milliseconds(CATCH_UP_LIMIT_MS)) : frame_time;
 
-    auto start_time = steady_clock::now(); // Initial playback loop time
-    
     // start audio
     music.play_audio();
 
 	// Perform frames rendering
-	while (!frame_buffer.empty()) {
-	    
-	    // Get frame to render from the FIFO buffer
-	    Frame current_frame = frame_buffer.front();
-	    frame_buffer.erase(frame_buffer.begin());  // Remove the frame from the buffer
-	
+	FrameHandle current_frame;
+	bool first_frame = true;
+	size_t allocations_at_first_frame = 0;  // steady state: after the first frame and the start of audio
+	size_t write_calls_at_start = output.get_write_calls();
+	auto write_time_at_start = output.get_write_time();
+	size_t bytes_at_start = stats.bytes_written;
+	size_t frame_index = 0;
+	size_t last_queued = 0;  // bytes queued for the output at the previous check
+	size_t written_since_check = 0;  // bytes written since then
+	auto last_check_time = start_time;
+	double frame_seconds = duration<double>(frame_time).count();
+	size_t last_adaptation_frame = 0;
+	double average_write_ms = 0;  // moving average of the time spent writing a frame
+	size_t backlog_skips_at_adaptation = stats.backlog_skips;
+	bool lightenable = adapt_output;  // until every lightening step is used
+	while (!ExitHandler::exit_requested() && next_frame(current_frame)) {
+
+	    // Compare the wall clock with the presentation time: the frame is late once the next one is due
+	    auto delay = steady_clock::now() - pacer.deadline(frame_index++);
+	    if (late_policy != LatePolicy::SLOW_MOTION && delay >= drop_delay) {
+	        // Skip the frame (back to the pool with the next one taken): the screen keeps the last frame displayed
+	        stats.frames_dropped++;
+	        continue;
+	    }
+
+	    // Measure the rate at which the output drains while it stays busy (bytes queued at two checks in a row):
+	    // short of backpressure, the queue empties between frames and bytes only queued briefly say nothing about it
+	    auto check_time = steady_clock::now();
+	    size_t queued = output.queued_bytes();
+	    stats.max_queued_bytes = std::max(stats.max_queued_bytes, queued);
+	    if (queued > 0 && last_queued > 0 && last_queued + written_since_check >= queued && check_time > last_check_time) {
+	        double rate = (last_queued + written_since_check - queued) / duration<double>(check_time - last_check_time).count();
+	        stats.drain_rate += (rate - stats.drain_rate) / (stats.drain_rate > 0 ? WRITE_TIME_SMOOTHING : 1);
+	    }
+	    last_queued = queued;
+	    written_since_check = 0;
+	    last_check_time = check_time;
+
+	    // Skip the frame while the output holds more than it drains in a frame time: writing more would only block
+	    if (late_policy != LatePolicy::SLOW_MOTION && stats.drain_rate > 0 && queued > stats.drain_rate * frame_seconds) {
+	        stats.frames_dropped++;
+	        stats.backlog_skips++;
+	        pacer.wait_until(pacer.deadline(frame_index));  // give the output a frame time to drain
+	        continue;
+	    }
+
 	    // Display the frame
 	    // outs << "\033[2J";  // Clear the screen
-	    outs << "\033[H";  // Set the cursor to the top-left position
-	    outs << renderer.render_frame(current_frame);  // Output the frame
-	
-	    // Calculate the target time for the next iteration to start
-	    auto target_next_frame_time = start_time + milliseconds(frame_time_ms);
+	    const std::string& rendered_frame = renderer.render_frame(*current_frame);
+	    output.write_frame(rendered_frame);  // Output the frame (or its changes since the previous one) at once
+	    stats.frames_rendered++;
+	    stats.full_redraws += renderer.last_frame_full() ? 1 : 0;
+	    stats.bytes_written += rendered_frame.size();
+	    stats.max_frame_bytes = std::max(stats.max_frame_bytes, rendered_frame.size());
+	    written_since_check += rendered_frame.size();
+	    double write_ms = duration<double, std::milli>(output.get_last_write_time()).count();
+	    stats.max_write_ms = std::max(stats.max_write_ms, write_ms);
+	    average_write_ms += (write_ms - average_write_ms) / WRITE_TIME_SMOOTHING;
+
+	    if (first_frame) {
+	        first_frame = false;
+	        allocations_at_first_frame = AllocationCounter::count();
+	    }
+
+	    // Lighten the rendering when writes block for most of the frame time or frames are skipped on backlog,
+	    // at most once per second so that the effect of the previous change shows in the measures
 	    auto now = steady_clock::now();
-	
-	    // Calculate the remaining time to reach the next frame
-	    int time_to_wait_ms = duration_cast<milliseconds>(target_next_frame_time - now).count();
-	
-	    if (time_to_wait_ms > 0) {
-	        // Wait for the remaining time
-	        std::this_thread::sleep_for(milliseconds(time_to_wait_ms));
+	    bool pressure = average_write_ms > frame_ms / 2 || stats.backlog_skips > backlog_skips_at_adaptation;
+	    if (lightenable && pressure && frame_index >= last_adaptation_frame + static_cast<size_t>(fps)) {
+	        double output_rate = (stats.bytes_written - bytes_at_start) / duration<double>(now - start_time).count();
+	        // Past the last step, the late policy drops the frames that cannot be displayed: stop sampling
+	        lightenable = lighten_rendering(frame_index - 1, average_write_ms, output_rate);
+	        stats.lightest_rendering |= !lightenable;
+	        last_adaptation_frame = frame_index;
+	        backlog_skips_at_adaptation = stats.backlog_skips;
 	    }
-	
-	    // Update start_time to the target time, regardless of any accumulated delay
-	    start_time = target_next_frame_time;
-	
-	    // Trigger fetching new frames if the buffer is running low
-	    if (!all_read && frame_buffer.size() <= buffer_threshold) {
-	        all_read = all_read || !fetch_next_frames();
+
+	    // The deadline of the next frame comes from its index, regardless of any accumulated delay (unless in slow motion)
+	    if (now > pacer.deadline(frame_index)) {
+	        stats.frames_late++;  // the frame was not displayed within its slot
+	        if (late_policy == LatePolicy::SLOW_MOTION) {
+	            pacer.shift(now - pacer.deadline(frame_index));  // shift the following frames rather than rushing them
+	        }
 	    }
+
+	    // Wait for the start of the next frame
+	    pacer.wait_until(pacer.deadline(frame_index));
+	}
+	if (!first_frame) {
+	    stats.allocations += AllocationCounter::count() - allocations_at_first_frame;
 	}
+	stats.write_calls += output.get_write_calls() - write_calls_at_start;
+	stats.jitter = pacer.get_jitter();
+	stats.write_ms += duration<double, std::milli>(output.get_write_time() - write_time_at_start).count();
+	stats.playback_seconds += duration<double>(steady_clock::now() - start_time).count();
+
+	stop_decoding();
 }
 
+// Steps: coalesced delta rendering (if disabled), then fewer colors: each step writes fewer bytes per frame.
+bool CLIMPlayer::lighten_rendering(const size_t frame_index, const double write_ms, const double output_rate) {
+    RenderOptions render = renderer.get_options();
+    const char* change;
+    if (render.escape_mode != EscapeMode::PER_RUN || render.redraw_threshold < RenderOptions().redraw_threshold) {
+        render.escape_mode = EscapeMode::PER_RUN;
+        render.redraw_threshold = std::max(render.redraw_threshold, RenderOptions().redraw_threshold);
+        change = "coalesced delta rendering";
+    } else if (render.color_mode == ColorMode::TRUE_COLOR) {
+        render.color_mode = ColorMode::COLORS_256;
+        change = "256 colors";
+    } else if (render.color_mode == ColorMode::COLORS_256) {
+        render.color_mode = ColorMode::COLORS_16;
+        change = "16 colors";
+    } else {
+        return false;  // nothing left to lighten: the late policy drops the frames that cannot be displayed
+    }
+    renderer.set_options(render);
+    if (stats.adaptation_count < PlaybackStats::MAX_ADAPTATIONS) {
+        OutputAdaptation& adaptation = stats.adaptations[stats.adaptation_count++];
+        adaptation.frame = frame_index;
+        adaptation.change = change;
+        adaptation.write_ms = write_ms;
+        adaptation.output_rate = output_rate;
+    }
+    return true;
+}
 
-void CLIMPlayer::play(std::ostream& outs, const bool loop) {
-	play_clim(outs);
-	while (loop) {
+void CLIMPlayer::play(OutputSink& output, const bool loop) {
+	play_clim(output);
+	while (loop && !ExitHandler::exit_requested()) {
 		decoder.set_cluster_for_frame(0);
-		play_clim(outs);
+		play_clim(output);
 	}
 }
-
-
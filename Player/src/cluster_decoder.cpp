@@ -2,89 +2,71 @@
 #include "bit_reader.h"
 #include <iostream>
 #include <stdexcept>  // exceptions
+#include <algorithm>
+
+const size_t ClusterDecoder::RUN_TABLE_MIN_RUNS;
 
 ClusterDecoder::ClusterDecoder(const size_t width, const size_t height)
 : width(width), height(height) {}
 
-std::vector<Frame> ClusterDecoder::decode_cluster(BinaryReader& binary_data_reader,
-size_t& index, size_t number_of_frames_in_cluster) {
-    std::vector<Frame> frames(number_of_frames_in_cluster);
-    
-    // Step 1: Decode palette header
-    HuffmanCodebook<Color> palette = decode_palette(binary_data_reader, index);
-
-    // Step 2: Decode cluster flat frames and transform them into frames
-    FlatFrame flat_frame;
-    for (size_t i = 0; i < number_of_frames_in_cluster; ++i) {
-        flat_frame = decode_frame(binary_data_reader, index, palette);
-        frames[i] = flat_frame.to_frame(width, height);
-    }
-
-    return frames;
-}
-
 void ClusterDecoder::pass_cluster(BinaryReader& binary_data_reader, size_t& index, size_t number_of_frames_in_cluster) {
     // Step 1: Decode palette header
-    HuffmanCodebook<Color> palette = decode_palette(binary_data_reader, index);
+    decode_palette(binary_data_reader, index, skipped_colors);
 
-    // Step 2: Decode cluster flat frames
+    // Step 2: Skip cluster frames (codes are walked through, pixels are not stored)
     for (size_t i = 0; i < number_of_frames_in_cluster; ++i) {
-        decode_frame(binary_data_reader, index, palette);
+        pass_frame(binary_data_reader, index);
     }
 }
 
-HuffmanCodebook<Color> ClusterDecoder::decode_palette(BinaryReader& data_reader, size_t& index) {
-    HuffmanCodebook<Color> palette;
-    std::unordered_map<byte, Color> colors;
+void ClusterDecoder::decode_palette(BinaryReader& data_reader, size_t& index, Palette& colors) {
+    palette.clear();
+    byte num_bits_huffman_codes[Palette::MAX_COLORS];  // a byte holds the number of colors - 1
+
+    BitReader bit_reader(data_reader, index * 8);  // index [Byte] * 8 <=> index [bit]
 
     // Read the number of colors in the palette
-    byte num_colors = data_reader.get_byte(index++) + 1;
+    size_t num_colors = bit_reader.read_bits(8) + 1;
+    colors.size = num_colors;
     
     // Read colors
-    for (byte i = 0; i < num_colors; ++i) {
-        byte r = data_reader.get_byte(index++);
-        byte g = data_reader.get_byte(index++);
-        byte b = data_reader.get_byte(index++);
-        colors[i] = {r, g, b};
+    for (size_t i = 0; i < num_colors; ++i) {
+        byte r = bit_reader.read_bits(8);
+        byte g = bit_reader.read_bits(8);
+        byte b = bit_reader.read_bits(8);
+        colors.colors[i] = {r, g, b};
     }
     
     // Read the huffman codes length (each in 3-bit binary)
-    byte num_bits_huffman_codes[num_colors];
-    BitReader bit_reader(data_reader, index * 8);  // index [Byte] * 8 <=> index [bit]
-    for (byte i = 0; i < num_colors; ++i) {
+    for (size_t i = 0; i < num_colors; ++i) {
         num_bits_huffman_codes[i] = bit_reader.read_bits(3) + 1;
     }
     
     // after huffman codes length need to align to byte
-    index = bit_reader.align_to_byte();
+    bit_reader.align_to_byte();
     
     // Read the huffman codes (dynamic length each)
-    std::string code;
-    for (byte i = 0; i < num_colors; ++i) {
-    	code = bit_reader.read_bit_string(num_bits_huffman_codes[i]);
-    	palette.insert(code, colors[i]);
+    for (size_t i = 0; i < num_colors; ++i) {
+    	uint32_t code = bit_reader.read_bits(num_bits_huffman_codes[i]);
+    	palette.insert(code, num_bits_huffman_codes[i], colors.colors[i]);
     }
     
+    // Build the lookup tables once for the whole cluster (the multi-symbol one when a frame needs it)
+    palette.build();
+    palette_symbols_built = false;
+    
     // update index to the next aligned byte
     index = bit_reader.align_to_byte();
-    
-    return palette;
 }
 
-FlatFrame ClusterDecoder::decode_frame(BinaryReader& data_reader, size_t& index,
-const HuffmanCodebook<Color>& palette) {
-    FlatFrame frame;
-	size_t frame_dimension = width * height;
+void ClusterDecoder::decode_frame_header(BitReader& bit_reader) {
+    header.rle_bit_length = 0;
+    header.rle_huffman_codebook.clear();
 
     // Step 1: Read encoding method from header
-    BitReader bit_reader(data_reader, index * 8); // Initialize BitReader at the current bit position
     bool is_rle = bit_reader.read_bits(1); // First bit indicates if RLE is used
     bool uses_huffman = is_rle ? bit_reader.read_bits(1) : false; // Second bit (if RLE) indicates if Huffman is used
-    size_t rle_bit_length = 0;
-    
-    HuffmanCodebook<size_t> rle_huffman_codebook;
-    
-    //* DEBUG */ std::cout << "frame@" << index << " -> " << (is_rle?(uses_huffman?"RLE + HUFFMAN":"RLE"):"HUFFMAN") << "\n";
+    header.encoding = is_rle ? (uses_huffman ? Encoding::RLE_HUFFMAN : Encoding::RLE) : Encoding::HUFFMAN;
 
     // Step 2: Process header for RLE if applicable
     if (is_rle) {
@@ -100,80 +82,325 @@ const HuffmanCodebook<Color>& palette) {
             for (size_t i = 0; i < num_codes; ++i) {
                 size_t count = bit_reader.read_bits(max_value_bits) + 1;  // RLE count
                 size_t code_length = bit_reader.read_bits(4) + 1;  // Length in bits of the Huffman code
-                std::string code = bit_reader.read_bit_string(code_length);
-                rle_huffman_codebook.insert(code, count);
+                uint32_t code = bit_reader.read_bits(code_length);
+                header.rle_huffman_codebook.insert(code, code_length, count);
             }
+            header.rle_huffman_codebook.build();
         } else {  // Direct RLE bit length
-            rle_bit_length = bit_reader.read_bits(5) + 1; // RLE bit length
+            header.rle_bit_length = bit_reader.read_bits(5) + 1; // RLE bit length
         }
     }
+}
+
+void ClusterDecoder::throw_invalid_code(const bool count) const {
+    const char* method = header.encoding == Encoding::RLE_HUFFMAN ? "RLE+Huffman"
+                         : header.encoding == Encoding::RLE ? "RLE" : "Huffman";
+    if (count) {
+        std::cerr << "Invalid RLE+Huffman codebook for counts:\n" << header.rle_huffman_codebook.to_codebook();
+        throw std::runtime_error("count code not found during RLE+Huffman decoding");
+    }
+    std::cerr << "Invalid palette:\n" << palette.to_codebook();
+    throw std::runtime_error(std::string("palette code not found during ") + method + " decoding");
+}
 
-    // Step 3: Decode pixel data
-    while (frame.pixels.size() < frame_dimension) {
-        if (is_rle) {
-            if (uses_huffman) {
-                // Decode palette index using Huffman, then RLE using Huffman codebook
-                // 1. code (to color)
-                std::string palette_code = "";
-                while (!palette.contains(palette_code)) {
-                    palette_code += bit_reader.read_bit_string(1);
-                    if (palette_code.length() > 8) {
-                    	std::cerr << "Invalid palette:\n" << palette;
-                    	throw std::runtime_error("palette code not found during RLE+Huffman decoding");
-					}
-                }
-                Color color = palette.at(palette_code);
-                // 2. code (to count)
-                std::string count_code = "";
-                while (!rle_huffman_codebook.contains(count_code)) {
-                    count_code += bit_reader.read_bit_string(1);
-                    if (count_code.length() > 16) {
-                    	std::cerr << "Invalid RLE+Huffman codebook for counts:\n" << rle_huffman_codebook;
-                    	throw std::runtime_error("count code not found during RLE+Huffman decoding");
-					}
+void ClusterDecoder::throw_run_overflow(const size_t count) const {
+    throw std::runtime_error("run of " + std::to_string(count) + " pixels exceeds the frame dimensions ("
+                             + std::to_string(width) + " x " + std::to_string(height) + ")");
+}
+
+size_t ClusterDecoder::max_run_bits() const {
+    size_t run_bits = palette.max_code_length();
+    if (header.encoding == Encoding::RLE) {
+        run_bits += header.rle_bit_length;
+    } else if (header.encoding == Encoding::RLE_HUFFMAN) {
+        run_bits += header.rle_huffman_codebook.max_code_length();
+    }
+    return run_bits;
+}
+
+template <ClusterDecoder::Encoding ENCODING, bool BUFFERED>
+inline size_t ClusterDecoder::decode_run(BitReader& bit_reader, size_t& count) {
+    // 1. code (to color)
+    size_t palette_symbol = palette.decode_symbol<BUFFERED>(bit_reader);
+    if (palette_symbol == HuffmanDecoder<Color>::INVALID_SYMBOL) {
+        throw_invalid_code(false);
+    }
+
+    // 2. count (a single pixel if not RLE): the encoding is known at compile time, the other branches vanish
+    if (ENCODING == Encoding::HUFFMAN) {
+        count = 1;
+    } else if (ENCODING == Encoding::RLE_HUFFMAN) {
+        size_t count_symbol = header.rle_huffman_codebook.decode_symbol<BUFFERED>(bit_reader);
+        if (count_symbol == HuffmanDecoder<size_t>::INVALID_SYMBOL) {
+            throw_invalid_code(true);
+        }
+        count = header.rle_huffman_codebook.value(count_symbol);
+    } else {
+        count = (BUFFERED ? bit_reader.read_bits_buffered(header.rle_bit_length)
+                          : bit_reader.read_bits(header.rle_bit_length)) + 1;
+    }
+
+    return palette_symbol;
+}
+
+template <ClusterDecoder::Encoding ENCODING, bool FUSED>
+void ClusterDecoder::decode_pixels(BitReader& bit_reader, Frame& frame) {
+    // Longest run in bits: as many runs as fit in a refilled bit buffer are decoded without checks
+    size_t run_bits = max_run_bits();
+    size_t runs_per_refill = BitReader::MAX_PEEK_BITS / std::max<size_t>(run_bits, 1);
+    size_t refill_bits = runs_per_refill * run_bits;
+
+    size_t remaining = width * height;
+    size_t column = 0;
+    uint8_t* row = frame.row(0);
+    size_t count;
+    while (remaining > 0) {
+        // A batch of runs straight from the bit buffer, or a single checked run close to the end of the data
+        bool buffered = runs_per_refill > 0 && bit_reader.ensure(refill_bits);
+        size_t runs = buffered ? runs_per_refill : 1;
+        for (; runs > 0 && remaining > 0; --runs) {
+            uint8_t color;
+            const RunTable::Entry* entry = nullptr;
+            if (FUSED && buffered) {
+                // Both codes of the run at once when they fit in the table window (the bits past the buffer are zeros,
+                // but the codes matched are those of the run, whose bits are buffered)
+                entry = &run_table.lookup(static_cast<uint32_t>(bit_reader.peek_buffered(RunTable::TABLE_BITS)));
+            }
+            if (FUSED && entry && entry->length) {
+                bit_reader.consume_buffered(entry->length);
+                color = entry->symbol;
+                count = entry->count;
+            } else {
+                color = static_cast<uint8_t>(buffered ? decode_run<ENCODING, true>(bit_reader, count)
+                                                      : decode_run<ENCODING, false>(bit_reader, count));
+            }
+            if (ENCODING == Encoding::HUFFMAN) {
+                // A single pixel
+                row[column] = color;
+                remaining--;
+                if (++column == width) {
+                    column = 0;
+                    row += frame.stride;
                 }
-                size_t count = rle_huffman_codebook.at(count_code);
-                // Append decoded pixels
-                for (size_t i = 0; i < count; ++i) {
-                    frame.pixels.push_back(color);
+                continue;
+            }
+            if (count > remaining) {
+                throw_run_overflow(count);
+            }
+            remaining -= count;
+            // Write decoded pixels, the run may wrap over several rows
+            while (count > 0) {
+                size_t length = std::min(count, width - column);
+                std::fill_n(row + column, length, color);
+                count -= length;
+                column += length;
+                if (column == width) {
+                    column = 0;
+                    row += frame.stride;
                 }
+            }
+        }
+    }
+}
+
+bool ClusterDecoder::use_palette_symbols() {
+    if (!palette_symbols_built) {
+        palette_symbols_built = true;
+        palette_symbols_used = false;
+        // Building costs about as much as decoding a frame of the table size
+        if (width * height >= (static_cast<size_t>(1) << MultiSymbolTable::TABLE_BITS)
+            && MultiSymbolTable::supports(palette)) {
+            palette_symbols.build(palette);
+            // With a single code per lookup (e.g. fixed-length codes) the plain loop is faster
+            palette_symbols_used = palette_symbols.average_symbols() >= 2;
+        }
+    }
+    return palette_symbols_used;
+}
+
+bool ClusterDecoder::use_run_table() {
+    if (!RunTable::supports(palette)) {
+        return false;
+    }
+    // Expected run length: each code of length L takes a share 2^-L of the runs
+    const HuffmanDecoder<size_t>& counts = header.rle_huffman_codebook;
+    double average_count = 0;
+    for (size_t i = 0; i < counts.size(); ++i) {
+        average_count += counts.value(i) / static_cast<double>(static_cast<size_t>(1) << counts.code_length(i));
+    }
+    // Building costs about as much as the lookups save on ~2000 runs (half the table size): the table is only used
+    // from the table size of runs, where the saving clearly outweighs it
+    double expected_runs = width * height / std::max(average_count, 1.0);
+    if (expected_runs < RUN_TABLE_MIN_RUNS) {
+        return false;
+    }
+    run_table.build(palette, counts);
+    return true;
+}
+
+void ClusterDecoder::decode_huffman_pixels(BitReader& bit_reader, Frame& frame) {
+    const size_t TABLE_BITS = MultiSymbolTable::TABLE_BITS;
+    const size_t MAX_SYMBOLS = MultiSymbolTable::MAX_SYMBOLS;
+    const size_t LOOKUPS_PER_REFILL = BitReader::MAX_PEEK_BITS / TABLE_BITS;
+    size_t remaining = width * height;
+    size_t column = 0;
+    uint8_t* row = frame.row(0);
+    // Lookups straight from the bit buffer, as long as any entry fits in the pixels left
+    while (remaining >= LOOKUPS_PER_REFILL * MAX_SYMBOLS && bit_reader.ensure(LOOKUPS_PER_REFILL * TABLE_BITS)) {
+        for (size_t lookup = 0; lookup < LOOKUPS_PER_REFILL; ++lookup) {
+            const MultiSymbolTable::Entry& entry
+                = palette_symbols.lookup(static_cast<uint32_t>(bit_reader.peek_buffered(TABLE_BITS)));
+            if (entry.count == 0) {
+                throw_invalid_code(false);  // the first code always fits in the window: none matches
+            }
+            bit_reader.consume_buffered(entry.length);
+            remaining -= entry.count;
+            if (column + MAX_SYMBOLS <= width) {
+                // Copy all the symbols at once: the ones beyond the count are overwritten by the next entries
+                std::copy(entry.symbols, entry.symbols + MAX_SYMBOLS, row + column);
+                column += entry.count;
             } else {
-                // Decode RLE directly
-                // 1. code (to color)
-                std::string palette_code = "";
-                while (!palette.contains(palette_code)) {
-                    palette_code += bit_reader.read_bit_string(1);
-                    if (palette_code.length() > 8) {
-                    	std::cerr << "Invalid palette:\n" << palette;
-                    	throw std::runtime_error("palette code not found during RLE decoding");
-					}
-                }
-                Color color = palette.at(palette_code);
-                // 2. count
-                size_t count = bit_reader.read_bits(rle_bit_length) + 1;
-                // Append decoded pixels
-                for (size_t i = 0; i < count; ++i) {
-                    frame.pixels.push_back(color);
+                for (size_t i = 0; i < entry.count; ++i) {
+                    row[column] = entry.symbols[i];
+                    if (++column == width) {
+                        column = 0;
+                        row += frame.stride;
+                    }
                 }
+                continue;
+            }
+            if (column == width) {
+                column = 0;
+                row += frame.stride;
+            }
+        }
+    }
+
+    // Last pixels (or close to the end of the data): one checked code at a time
+    size_t count;
+    for (; remaining > 0; --remaining) {
+        row[column] = static_cast<uint8_t>(decode_run<Encoding::HUFFMAN, false>(bit_reader, count));
+        if (++column == width) {
+            column = 0;
+            row += frame.stride;
+        }
+    }
+}
+
+template <ClusterDecoder::Encoding ENCODING, bool FUSED>
+void ClusterDecoder::pass_pixels(BitReader& bit_reader) {
+    // The batches of decode_pixels, counting the pixels of the runs instead of writing them
+    size_t run_bits = max_run_bits();
+    size_t runs_per_refill = BitReader::MAX_PEEK_BITS / std::max<size_t>(run_bits, 1);
+    size_t refill_bits = runs_per_refill * run_bits;
+
+    size_t remaining = width * height;
+    size_t count;
+    while (remaining > 0) {
+        bool buffered = runs_per_refill > 0 && bit_reader.ensure(refill_bits);
+        size_t runs = buffered ? runs_per_refill : 1;
+        for (; runs > 0 && remaining > 0; --runs) {
+            const RunTable::Entry* entry = nullptr;
+            if (FUSED && buffered) {
+                entry = &run_table.lookup(static_cast<uint32_t>(bit_reader.peek_buffered(RunTable::TABLE_BITS)));
+            }
+            if (FUSED && entry && entry->length) {
+                bit_reader.consume_buffered(entry->length);
+                count = entry->count;
+            } else if (buffered) {
+                decode_run<ENCODING, true>(bit_reader, count);
+            } else {
+                decode_run<ENCODING, false>(bit_reader, count);
+            }
+            if (count > remaining) {
+                throw_run_overflow(count);
+            }
+            remaining -= count;
+        }
+    }
+}
+
+void ClusterDecoder::pass_huffman_pixels(BitReader& bit_reader) {
+    const size_t TABLE_BITS = MultiSymbolTable::TABLE_BITS;
+    const size_t MAX_SYMBOLS = MultiSymbolTable::MAX_SYMBOLS;
+    const size_t LOOKUPS_PER_REFILL = BitReader::MAX_PEEK_BITS / TABLE_BITS;
+    size_t remaining = width * height;
+    // Lookups straight from the bit buffer, as in decode_huffman_pixels, only counting the symbols
+    while (remaining >= LOOKUPS_PER_REFILL * MAX_SYMBOLS && bit_reader.ensure(LOOKUPS_PER_REFILL * TABLE_BITS)) {
+        for (size_t lookup = 0; lookup < LOOKUPS_PER_REFILL; ++lookup) {
+            const MultiSymbolTable::Entry& entry
+                = palette_symbols.lookup(static_cast<uint32_t>(bit_reader.peek_buffered(TABLE_BITS)));
+            if (entry.count == 0) {
+                throw_invalid_code(false);
             }
-        } else {
-            // Decode pixel data using Huffman only
-            // code (to color)
-            std::string palette_code = "";
-            while (!palette.contains(palette_code)) {
-                palette_code += bit_reader.read_bit_string(1);
-                    if (palette_code.length() > 8) {
-                    	std::cerr << "Invalid palette:\n" << palette;
-                    	throw std::runtime_error("palette code not found during Huffman decoding");
-					}
-            }
-            // Append decoded pixel
-            frame.pixels.push_back(palette.at(palette_code));
+            bit_reader.consume_buffered(entry.length);
+            remaining -= entry.count;
         }
     }
 
+    // Last pixels (or close to the end of the data): one checked code at a time
+    size_t count;
+    for (; remaining > 0; --remaining) {
+        decode_run<Encoding::HUFFMAN, false>(bit_reader, count);
+    }
+}
+
+void ClusterDecoder::decode_frame(BinaryReader& data_reader, size_t& index, Frame& frame) {
+    // Read the frame header
+    BitReader bit_reader(data_reader, index * 8); // Initialize BitReader at the current bit position
+    decode_frame_header(bit_reader);
+
+    // Decode pixel data (a palette code, then the length of the run if RLE) with the loop of the encoding
+    switch (header.encoding) {
+        case Encoding::HUFFMAN:
+            if (use_palette_symbols()) {
+                decode_huffman_pixels(bit_reader, frame);
+            } else {
+                decode_pixels<Encoding::HUFFMAN>(bit_reader, frame);
+            }
+            break;
+        case Encoding::RLE:
+            decode_pixels<Encoding::RLE>(bit_reader, frame);
+            break;
+        case Encoding::RLE_HUFFMAN:
+            if (use_run_table()) {
+                decode_pixels<Encoding::RLE_HUFFMAN, true>(bit_reader, frame);
+            } else {
+                decode_pixels<Encoding::RLE_HUFFMAN>(bit_reader, frame);
+            }
+            break;
+    }
+
     // Update index to reflect the current byte-aligned position in the BitReader
     index = bit_reader.align_to_byte();
-    return frame;
 }
 
+void ClusterDecoder::pass_frame(BinaryReader& data_reader, size_t& index) {
+    // Read the frame header
+    BitReader bit_reader(data_reader, index * 8); // Initialize BitReader at the current bit position
+    decode_frame_header(bit_reader);
+
+    // Walk through the codes with the loop of the encoding (and the lookup tables decode_frame would use)
+    switch (header.encoding) {
+        case Encoding::HUFFMAN:
+            if (use_palette_symbols()) {
+                pass_huffman_pixels(bit_reader);
+            } else {
+                pass_pixels<Encoding::HUFFMAN>(bit_reader);
+            }
+            break;
+        case Encoding::RLE:
+            pass_pixels<Encoding::RLE>(bit_reader);
+            break;
+        case Encoding::RLE_HUFFMAN:
+            if (use_run_table()) {
+                pass_pixels<Encoding::RLE_HUFFMAN, true>(bit_reader);
+            } else {
+                pass_pixels<Encoding::RLE_HUFFMAN>(bit_reader);
+            }
+            break;
+    }
+
+    // Update index to reflect the current byte-aligned position in the BitReader
+    index = bit_reader.align_to_byte();
+}
@@ -0,0 +1,219 @@
+#include "cluster_workers.h"
+#include <functional>  // std::ref
+
+void ClusterWorkers::start(const std::string& file_path, const size_t width, const size_t height,
+                           const std::vector<size_t>& cluster_dimensions, const size_t threads,
+                           const size_t max_cluster_frames) {
+    stop();
+    this->cluster_dimensions = &cluster_dimensions;
+    // Two jobs per worker: one being decoded, one decoded and waiting to be taken back
+    jobs = std::vector<Job>(2 * threads);
+    for (Job& job : jobs) {
+        job.frames.reserve(max_cluster_frames);
+    }
+    first_job = 0;
+    job_count = 0;
+    scan_state = JobState::FREE;
+    scanned_byte_indices.assign(cluster_dimensions.size() + 1, 0);
+    scanned_cluster_index = scan_cluster_index = 0;
+    stopping = false;
+    cancelling = false;
+    // Readers are set up here, so that an unreadable file throws to the caller
+    for (size_t i = 0; i < threads; ++i) {
+        std::unique_ptr<Worker> worker(new Worker());
+        worker->reader.setup(file_path, (1 << 16), (1 << 8));
+        worker->decoder = ClusterDecoder(width, height);
+        workers.push_back(std::move(worker));
+    }
+    for (std::unique_ptr<Worker>& worker : workers) {
+        worker->thread = std::thread(&ClusterWorkers::work, this, std::ref(*worker));
+    }
+}
+
+void ClusterWorkers::stop() {
+    if (workers.empty()) {
+        return;
+    }
+    cancel();
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        stopping = true;
+    }
+    work_available.notify_all();
+    for (std::unique_ptr<Worker>& worker : workers) {
+        worker->thread.join();
+    }
+    workers.clear();
+    jobs.clear();
+}
+
+bool ClusterWorkers::can_submit() const {
+    std::lock_guard<std::mutex> lock(mutex);
+    return job_count < jobs.size();
+}
+
+void ClusterWorkers::submit(const size_t cluster_index, const size_t byte_index,
+                            const std::shared_ptr<Palette>& colors, FramePool& pool) {
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        Job& job = jobs[(first_job + job_count++) % jobs.size()];
+        job.state = JobState::PENDING;
+        job.cluster_index = cluster_index;
+        job.byte_index = byte_index;
+        job.colors = colors;
+        job.pool = &pool;
+    }
+    work_available.notify_one();
+}
+
+bool ClusterWorkers::is_next(const size_t cluster_index) const {
+    std::lock_guard<std::mutex> lock(mutex);
+    return job_count > 0 && jobs[first_job].cluster_index == cluster_index;
+}
+
+void ClusterWorkers::take(std::vector<FrameHandle>& frames, size_t& end_byte_index) {
+    std::unique_lock<std::mutex> lock(mutex);
+    Job& job = jobs[first_job];
+    work_finished.wait(lock, [&job]() {
+        return job.state == JobState::DONE;
+    });
+    // Swap the frame lists: both keep their capacity
+    frames.clear();
+    frames.swap(job.frames);
+    end_byte_index = job.byte_index;
+    std::exception_ptr error = job.error;
+    job.colors.reset();  // only the frames refer to the palette now
+    job.error = nullptr;
+    job.state = JobState::FREE;
+    first_job = (first_job + 1) % jobs.size();
+    job_count--;
+    if (error) {
+        frames.clear();
+        std::rethrow_exception(error);
+    }
+}
+
+void ClusterWorkers::scan(const size_t cluster_index, const size_t byte_index, const size_t end_cluster_index) {
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        if (scan_state != JobState::FREE || end_cluster_index <= cluster_index) {
+            return;
+        }
+        scan_state = JobState::PENDING;
+        scan_cluster_index = scanned_cluster_index = cluster_index;
+        scan_byte_index = byte_index;
+        scan_end_cluster_index = end_cluster_index;
+    }
+    work_available.notify_one();
+}
+
+bool ClusterWorkers::scanned(const size_t cluster_index, size_t& byte_index) const {
+    std::lock_guard<std::mutex> lock(mutex);
+    if (cluster_index <= scan_cluster_index || cluster_index > scanned_cluster_index) {
+        return false;
+    }
+    byte_index = scanned_byte_indices[cluster_index];
+    return true;
+}
+
+void ClusterWorkers::cancel() {
+    std::unique_lock<std::mutex> lock(mutex);
+    cancelling = true;
+    // Forget the jobs not started, then wait for the running ones to stop
+    for (Job& job : jobs) {
+        if (job.state == JobState::PENDING) {
+            job.state = JobState::DONE;
+        }
+    }
+    if (scan_state == JobState::PENDING) {
+        scan_state = JobState::FREE;
+    }
+    work_finished.wait(lock, [this]() {
+        for (const Job& job : jobs) {
+            if (job.state == JobState::RUNNING) {
+                return false;
+            }
+        }
+        return scan_state == JobState::FREE;
+    });
+    for (Job& job : jobs) {
+        job.frames.clear();  // back to the pool
+        job.colors.reset();
+        job.error = nullptr;
+        job.state = JobState::FREE;
+    }
+    first_job = 0;
+    job_count = 0;
+    scanned_cluster_index = scan_cluster_index = 0;
+    cancelling = false;
+}
+
+void ClusterWorkers::work(Worker& worker) {
+    std::unique_lock<std::mutex> lock(mutex);
+    while (true) {
+        // The scan comes first: the jobs after it wait for the boundaries it finds
+        Job* next_job = nullptr;
+        work_available.wait(lock, [this, &next_job]() {
+            if (stopping || scan_state == JobState::PENDING) {
+                return true;
+            }
+            for (size_t i = 0; i < job_count; ++i) {
+                Job& job = jobs[(first_job + i) % jobs.size()];
+                if (job.state == JobState::PENDING) {
+                    next_job = &job;
+                    return true;
+                }
+            }
+            return false;
+        });
+        if (stopping) {
+            return;
+        }
+        if (scan_state == JobState::PENDING) {
+            scan_state = JobState::RUNNING;
+            lock.unlock();
+            run_scan(worker);
+            lock.lock();
+            scan_state = JobState::FREE;
+        } else {
+            next_job->state = JobState::RUNNING;
+            lock.unlock();
+            decode(worker, *next_job);
+            lock.lock();
+            next_job->state = JobState::DONE;
+        }
+        work_finished.notify_all();
+    }
+}
+
+void ClusterWorkers::decode(Worker& worker, Job& job) {
+    try {
+        size_t index = job.byte_index;
+        worker.decoder.decode_palette(worker.reader, index, *job.colors);
+        for (size_t i = 0; i < (*cluster_dimensions)[job.cluster_index] && !cancelling; ++i) {
+            FrameHandle frame = job.pool->acquire();
+            worker.decoder.decode_frame(worker.reader, index, *frame);
+            frame->palette = job.colors;
+            job.frames.push_back(std::move(frame));
+        }
+        job.byte_index = index;
+    } catch (...) {
+        job.error = std::current_exception();  // rethrown when the job is taken back
+    }
+}
+
+void ClusterWorkers::run_scan(Worker& worker) {
+    size_t cluster_index = scan_cluster_index;
+    size_t byte_index = scan_byte_index;
+    try {
+        while (cluster_index < scan_end_cluster_index && !cancelling) {
+            worker.decoder.pass_cluster(worker.reader, byte_index, (*cluster_dimensions)[cluster_index]);
+            cluster_index++;
+            std::lock_guard<std::mutex> lock(mutex);
+            scanned_byte_indices[cluster_index] = byte_index;
+            scanned_cluster_index = cluster_index;
+        }
+    } catch (const std::exception&) {
+        // stop there: the error shows up again when the cluster is decoded
+    }
+}
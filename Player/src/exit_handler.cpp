@@ -5,6 +5,7 @@ bool ExitHandler::initialized = false;
 std::unordered_map<size_t, cleanup_function_t> ExitHandler::cleanup_functions;
 size_t ExitHandler::current_id = 0;
 bool ExitHandler::is_cleaning_up = false;
+std::atomic<bool> ExitHandler::exit_request(false);
 
 size_t ExitHandler::add_cleanup_function(cleanup_function_t func) {
 	initialize();
@@ -46,7 +47,11 @@ void ExitHandler::initialize() {
 
 #ifdef _WIN32
 BOOL WINAPI ExitHandler::onCloseHandler(DWORD event) {
-    if (event == CTRL_CLOSE_EVENT || event == CTRL_C_EVENT) {  // Handle both close and Ctrl+C
+    if (event == CTRL_C_EVENT) {  // Ctrl+C: the program stops playing and returns
+        exit_request = true;
+        return TRUE;  // Signal handled
+    }
+    if (event == CTRL_CLOSE_EVENT) {  // Close: the process is killed once the handler returns
         execute_cleanup_functions();
         return TRUE;  // Signal handled
     }
@@ -54,8 +59,11 @@ BOOL WINAPI ExitHandler::onCloseHandler(DWORD event) {
 }
 #else
 void ExitHandler::onSignal(int signal) {
-    execute_cleanup_functions();
-    exit(0);  // Safe termination
+    // The cleanup functions join threads and take locks: they run from the destructors once the program returns
+    if (exit_request.exchange(true)) {
+        ::signal(signal, SIG_DFL);  // second signal: the program did not return, terminate at once
+        raise(signal);
+    }
 }
 #endif
 
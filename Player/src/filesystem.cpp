@@ -24,6 +24,33 @@ namespace std {
             return (std::remove(file_path.c_str()) == 0);
         }
 
+        // Function to get the last modification time of a file, with the sub-second part (a file rewritten
+        // within the same second must not look unchanged).
+        long long last_write_time(const std::string& file_path) {
+#ifdef _WIN32
+            // On Windows, the time is counted in 100 ns intervals since 1601-01-01.
+            WIN32_FILE_ATTRIBUTE_DATA attributes;
+            if (!GetFileAttributesExA(file_path.c_str(), GetFileExInfoStandard, &attributes)) {
+                return -1;
+            }
+            long long intervals = static_cast<long long>(attributes.ftLastWriteTime.dwHighDateTime) << 32
+                                  | attributes.ftLastWriteTime.dwLowDateTime;
+            return (intervals - 116444736000000000LL) * 100;
+#else
+            // On POSIX systems, stat gives the seconds and the nanoseconds (st_mtimespec on macOS).
+            struct stat info;
+            if (stat(file_path.c_str(), &info) != 0) {
+                return -1;
+            }
+#ifdef __APPLE__
+            const struct timespec& time = info.st_mtimespec;
+#else
+            const struct timespec& time = info.st_mtim;
+#endif
+            return static_cast<long long>(time.tv_sec) * 1000000000LL + time.tv_nsec;
+#endif
+        }
+
         // DIRECTORIES
 
         // Function to create directories recursively from the given path.
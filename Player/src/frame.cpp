@@ -1,62 +1,391 @@
 #include "frame.h"
-#include <stdexcept>
-#include <sstream>  // For constructing strings
+#include <cstring>
+#include <algorithm>
+#include <cstdlib>
 
-// Converts a flat vector of pixels into a 2D grid (Frame) of specified dimensions.
-Frame FlatFrame::to_frame(const size_t width, const size_t height) const {
-    size_t num_pixels = pixels.size();
+const char FrameRenderer::CURSOR_HOME[] = "\033[H";
+const char FrameRenderer::ROW_END[] = "\033[0m\n";
+const char FrameRenderer::DEFAULT_BACKGROUND[] = "\033[49m";
+const char FrameRenderer::UPPER_HALF_BLOCK[] = "\xE2\x96\x80";  // U+2580
+const char FrameRenderer::FULL_BLOCK[] = "\xE2\x96\x88";  // U+2588
+const size_t FrameRenderer::CURSOR_HOME_LENGTH;
+const size_t FrameRenderer::ROW_END_LENGTH;
+const size_t FrameRenderer::BLOCK_LENGTH;
+const size_t FrameRenderer::MAX_CURSOR_MOVE_LENGTH;
+const size_t FrameRenderer::MERGED_GAP;
+const int FrameRenderer::DEFAULT_COLOR;
 
-    // Validate that the number of pixels matches the grid dimensions.
-    if (num_pixels != width * height) {
-        throw std::invalid_argument(
-            "The number of pixels (" + std::to_string(num_pixels) + 
-            ") does not match the specified dimensions (" +
-            std::to_string(width) + " x " + std::to_string(height) + ").");
+// Constructor for FrameRenderer initializes the frame's dimensions.
+FrameRenderer::FrameRenderer(const size_t width, const size_t height, const RenderOptions& options)
+: width(width), height(height), options(options) {
+    output.reserve(max_output_size(width, height));
+    if (options.color_mode != ColorMode::TRUE_COLOR) {
+        build_fixed_escapes();
+    }
+    if (options.redraw_threshold > 0) {
+        previous_pixels.resize(width * height);
+        cell_changes.resize(width * ((height + pixel_rows_per_cell() - 1) / pixel_rows_per_cell()));
+    }
+}
+
+// Prepares again what depends on the settings: the fixed escape codes, the palette conversion and the buffers.
+void FrameRenderer::set_options(const RenderOptions& options) {
+    this->options = options;
+    if (options.color_mode != ColorMode::TRUE_COLOR) {
+        build_fixed_escapes();
+    }
+    escapes_palette = nullptr;  // convert the next palette again
+    if (options.redraw_threshold > 0) {
+        previous_pixels.resize(width * height);
+        cell_changes.resize(width * ((height + pixel_rows_per_cell() - 1) / pixel_rows_per_cell()));
+    }
+    output.reserve(max_output_size(width, height));
+    reset();  // the screen shows colors of the previous settings
+}
+
+// Prefers 24-bit colors when announced, then 256 colors when the terminal type has them.
+ColorMode FrameRenderer::detect_color_mode() {
+    const char* colorterm = std::getenv("COLORTERM");
+    if (colorterm && (std::strstr(colorterm, "truecolor") || std::strstr(colorterm, "24bit"))) {
+        return ColorMode::TRUE_COLOR;
     }
+    const char* term = std::getenv("TERM");
+    if (!term || !*term) {
+        return ColorMode::TRUE_COLOR;  // not a terminfo terminal (e.g. Windows console)
+    }
+    if (std::strstr(term, "256color")) {
+        return ColorMode::COLORS_256;
+    }
+    return ColorMode::COLORS_16;
+}
 
-    // Initialize the resulting frame with a grid of empty rows.
-    Frame frame;
-    frame.pixels_grid = std::vector<std::vector<Color>>(height);
+// Renders the frame (2D grid of pixels) into a string representation with ANSI color codes.
+const std::string& FrameRenderer::render_frame(const Frame& frame) {
+    // Format the escape codes once per palette (the same palette object is reused for later clusters)
+    if (frame.palette.get() != escapes_palette || frame.palette->id != escapes_palette_id) {
+        build_escapes(*frame.palette);
+    }
+    size_t cell_rows = (frame.height + pixel_rows_per_cell() - 1) / pixel_rows_per_cell();
 
-    std::vector<Color> frame_row;  // Temporary vector to store one row of the frame.
+    // Count the cells that changed since the previous frame
+    bool delta = options.redraw_threshold > 0 && has_previous && frame.width == width && frame.height == height;
+    if (delta) {
+        same_palette = frame.palette.get() == previous_palette_source && frame.palette->id == previous_palette.id;
+        size_t changed_cells = 0;
+        for (size_t cell_row = 0; cell_row < cell_rows; ++cell_row) {
+            changed_cells += mark_changed_cells(frame, cell_row);
+        }
+        delta = changed_cells <= options.redraw_threshold * frame.width * cell_rows;
+    }
 
-    // Loop through each pixel in the flat vector.
-    for (size_t pixel = 0; pixel < num_pixels; pixel++) {
-        // Add the current pixel to the temporary row.
-        frame_row.push_back(pixels[pixel]);
+    // Make room for the longest output, escape codes are copied whole and overlap the unused bytes
+    output.resize(max_output_size(frame.width, frame.height));
+    char* destination = &output[0];
+    std::memcpy(destination, CURSOR_HOME, CURSOR_HOME_LENGTH);  // Set the cursor to the top-left position
+    destination += CURSOR_HOME_LENGTH;
+    destination = delta ? write_changes(frame, destination) : write_rows(frame, destination);
+    output.resize(destination - output.data());  // keeps the capacity for the next frames
+    last_full = !delta;
 
-        // Check if the row is complete (i.e., it has reached the specified width).
-        if ((pixel + 1) % width == 0) {
-            // Assign the completed row to the corresponding grid row.
-            frame.pixels_grid[(pixel + 1) / width - 1] = frame_row;
-            frame_row.clear();  // Clear the temporary row for the next row.
+    // The frame rendered is now the one on screen
+    if (options.redraw_threshold > 0 && frame.width == width && frame.height == height) {
+        for (size_t y = 0; y < frame.height; ++y) {
+            std::memcpy(previous_pixels.data() + y * width, frame.row(y), width);
         }
+        if (frame.palette.get() != previous_palette_source || frame.palette->id != previous_palette.id) {
+            previous_palette = *frame.palette;
+            previous_palette_source = frame.palette.get();
+        }
+        has_previous = true;
+    } else {
+        has_previous = false;
     }
 
-    return frame;  // Return the constructed 2D frame.
+    return output;  // Return the complete string representation of the frame.
 }
 
-// Constructor for FrameRenderer initializes the frame's dimensions.
-FrameRenderer::FrameRenderer(const size_t width, const size_t height)
-: width(width), height(height) {}
+// Longest output: the cursor home, then the longest cell per cell ("\033[48;2;255;255;255m " for spaces, a foreground and
+// a background escape code and a block for half blocks) and "\033[0m\n" per row, or a cursor move per changed span
+// (spans are at least MERGED_GAP + 1 cells apart) and the final reset and move, plus room for a whole escape record.
+size_t FrameRenderer::max_output_size(const size_t width, const size_t height) const {
+    size_t cell_size = options.strategy == RenderStrategy::HALF_BLOCKS ? 2 * 19 + BLOCK_LENGTH : 19 + 1;
+    size_t cell_rows = (height + pixel_rows_per_cell() - 1) / pixel_rows_per_cell();
+    size_t spans_per_row = width / (MERGED_GAP + 1) + 1;
+    return CURSOR_HOME_LENGTH + cell_rows * (width * cell_size + spans_per_row * MAX_CURSOR_MOVE_LENGTH + ROW_END_LENGTH)
+           + 4 + MAX_CURSOR_MOVE_LENGTH + sizeof(Escape);
+}
 
-// Renders the frame (2D grid of pixels) into a string representation with ANSI color codes.
-std::string FrameRenderer::render_frame(const Frame& frame) {
-    std::ostringstream oss;
-
-    // Loop through each row in the frame grid.
-    for (const auto& row : frame.pixels_grid) {
-        // Loop through each pixel in the row.
-        for (const auto& pixel : row) {
-            // Append the ANSI color code for the pixel's RGB color.
-            oss << "\033[48;2;" << static_cast<int>(pixel.r) << ";" 
-                << static_cast<int>(pixel.g) << ";" 
-                << static_cast<int>(pixel.b) << "m ";
-        }
+// Writes the whole frame, row of cells after row of cells.
+char* FrameRenderer::write_rows(const Frame& frame, char* destination) const {
+    size_t cell_rows = (frame.height + pixel_rows_per_cell() - 1) / pixel_rows_per_cell();
+    for (size_t cell_row = 0; cell_row < cell_rows; ++cell_row) {
+        ColorState state = {DEFAULT_COLOR, DEFAULT_COLOR};
+        destination = write_cells(frame, cell_row, 0, frame.width, state, destination);
         // Reset formatting after the row and add a newline.
-        oss << "\033[0m\n";
+        std::memcpy(destination, ROW_END, ROW_END_LENGTH);
+        destination += ROW_END_LENGTH;
+    }
+    return destination;
+}
+
+// A cell changes if any of its pixels does: its rows of pixels are marked in turn. Within a palette, whole rows of
+// palette indices are compared by the SIMD kernel; across palettes (once per cluster), the colors pixel by pixel.
+size_t FrameRenderer::mark_changed_cells(const Frame& frame, const size_t cell_row) {
+    uint8_t* changes = cell_changes.data() + cell_row * width;
+    std::memset(changes, 0, width);
+    size_t changed = 0;
+    size_t y = cell_row * pixel_rows_per_cell();
+    size_t y_end = std::min(y + pixel_rows_per_cell(), frame.height);
+    for (; y < y_end; ++y) {
+        const uint8_t* row = frame.row(y);
+        const uint8_t* previous_row = previous_pixels.data() + y * width;
+        if (same_palette) {
+            changed = SimdKernels::mark_changes(row, previous_row, width, changes);
+            continue;
+        }
+        changed = 0;
+        for (size_t x = 0; x < width; ++x) {
+            changes[x] |= pixel_changed(frame, row[x], previous_row[x]);
+            changed += changes[x];
+        }
+    }
+    return changed;
+}
+
+// Writes the changed spans of each row, each after a cursor move (unchanged gaps shorter than a move are rewritten).
+char* FrameRenderer::write_changes(const Frame& frame, char* destination) const {
+    size_t cell_rows = (frame.height + pixel_rows_per_cell() - 1) / pixel_rows_per_cell();
+    ColorState state = {DEFAULT_COLOR, DEFAULT_COLOR};  // the colors are kept from span to span
+    for (size_t cell_row = 0; cell_row < cell_rows; ++cell_row) {
+        const uint8_t* changes = cell_changes.data() + cell_row * width;
+        size_t x = 0;
+        // Skip to the next changed cell (memchr is vectorized by the C library)
+        while (const void* next = std::memchr(changes + x, 1, frame.width - x)) {
+            x = static_cast<const uint8_t*>(next) - changes;
+            // Extend the span up to its last changed cell before a long enough unchanged gap
+            size_t last_changed = x;
+            for (size_t end = x + 1; end < frame.width && end - last_changed <= MERGED_GAP; ++end) {
+                if (changes[end]) {
+                    last_changed = end;
+                }
+            }
+            destination = write_cursor_move(destination, cell_row, x);
+            destination = write_cells(frame, cell_row, x, last_changed + 1, state, destination);
+            x = last_changed + 1;
+        }
     }
+    // Reset formatting and leave the cursor below the frame, as after a full redraw
+    std::memcpy(destination, "\033[0m", 4);
+    destination += 4;
+    return write_cursor_move(destination, cell_rows, 0);
+}
 
-    return oss.str();  // Return the complete string representation of the frame.
+// Writes the cells with the rendering strategy, from the pixel rows of the row of cells.
+char* FrameRenderer::write_cells(const Frame& frame, const size_t cell_row, const size_t begin, const size_t end,
+                                 ColorState& state, char* destination) const {
+    if (options.strategy == RenderStrategy::SPACES) {
+        const uint8_t* row = frame.row(cell_row);
+        return write_spaces(row + begin, row + end, state, destination);
+    }
+    size_t y = 2 * cell_row;
+    const uint8_t* bottom = y + 1 < frame.height ? frame.row(y + 1) + begin : nullptr;
+    return write_half_blocks(frame.row(y) + begin, bottom, end - begin, state, destination);
 }
 
+// Writes the cells, with an escape code before each one or only when the color changes.
+char* FrameRenderer::write_spaces(const uint8_t* pixel, const uint8_t* end, ColorState& state, char* destination) const {
+    if (options.escape_mode == EscapeMode::PER_PIXEL) {
+        // Copy the escape code of the color of each pixel, then a space.
+        if (pixel != end) {
+            state.background = terminal_colors[end[-1]];
+        }
+        return SimdKernels::write_escapes(destination, pixel, end - pixel, terminal_colors.data(),
+                                          background_escapes.data(), ' ');
+    }
+    // Loop through each run of pixels of the same terminal color: an escape code if the color changes, then spaces.
+    while (pixel != end) {
+        int color = terminal_colors[*pixel];
+        const uint8_t* run_end = pixel + 1;
+        while (run_end != end && terminal_colors[*run_end] == color) {
+            ++run_end;
+        }
+        if (color != state.background) {
+            destination = write_escape(background_escapes[color], destination);
+            state.background = color;
+        }
+        std::memset(destination, ' ', run_end - pixel);
+        destination += run_end - pixel;
+        pixel = run_end;
+    }
+    return destination;
+}
+
+// Writes the cells as upper half blocks: the top pixel is the foreground color, the bottom pixel the background color.
+// Coalescing escape codes, a cell of a single color already selected is a space (background) or a full block (foreground).
+char* FrameRenderer::write_half_blocks(const uint8_t* top, const uint8_t* bottom, const size_t count,
+                                       ColorState& state, char* destination) const {
+    bool per_pixel = options.escape_mode == EscapeMode::PER_PIXEL;
+    for (size_t x = 0; x < count; ++x) {
+        int foreground = terminal_colors[top[x]];
+        int background = bottom ? terminal_colors[bottom[x]] : DEFAULT_COLOR;  // no bottom row: the top row on the terminal background
+        const char* glyph = UPPER_HALF_BLOCK;
+        if (!per_pixel && foreground == background) {
+            if (background == state.background) {
+                *destination++ = ' ';
+                continue;
+            }
+            if (foreground == state.foreground) {
+                std::memcpy(destination, FULL_BLOCK, BLOCK_LENGTH);
+                destination += BLOCK_LENGTH;
+                continue;
+            }
+            glyph = nullptr;  // select the background only, for a space
+        }
+        if (glyph && (per_pixel || foreground != state.foreground)) {
+            destination = write_escape(foreground_escapes[foreground], destination);
+            state.foreground = foreground;
+        }
+        if (per_pixel || background != state.background) {
+            if (background == DEFAULT_COLOR) {
+                std::memcpy(destination, DEFAULT_BACKGROUND, sizeof(DEFAULT_BACKGROUND) - 1);
+                destination += sizeof(DEFAULT_BACKGROUND) - 1;
+            } else {
+                destination = write_escape(background_escapes[background], destination);
+            }
+            state.background = background;
+        }
+        if (glyph) {
+            std::memcpy(destination, glyph, BLOCK_LENGTH);
+            destination += BLOCK_LENGTH;
+        } else {
+            *destination++ = ' ';
+        }
+    }
+    return destination;
+}
+
+// Writes "\033[ROW;COLUMNH" (1-based).
+char* FrameRenderer::write_cursor_move(char* destination, const size_t row, const size_t column) {
+    *destination++ = '\033';
+    *destination++ = '[';
+    destination += format_number(destination, row + 1);
+    *destination++ = ';';
+    destination += format_number(destination, column + 1);
+    *destination++ = 'H';
+    return destination;
+}
+
+// In 24-bit colors, formats "\033[48;2;R;G;Bm" (background) and "\033[38;2;R;G;Bm" (foreground) for every color of the
+// palette; otherwise, looks up the nearest terminal color of every color of the palette.
+void FrameRenderer::build_escapes(const Palette& palette) {
+    for (size_t i = 0; i < palette.size; ++i) {
+        const Color& color = palette.colors[i];
+        switch (options.color_mode) {
+        case ColorMode::TRUE_COLOR: {
+            size_t components[] = {color.r, color.g, color.b};
+            format_escape(background_escapes[i], "48;2;", components, 3);
+            format_escape(foreground_escapes[i], "38;2;", components, 3);
+            terminal_colors[i] = static_cast<uint8_t>(i);
+            break;
+        }
+        case ColorMode::COLORS_256:
+            terminal_colors[i] = nearest_256_color(color);
+            break;
+        case ColorMode::COLORS_16:
+            terminal_colors[i] = nearest_16_color(color);
+            break;
+        }
+    }
+    escapes_palette = &palette;
+    escapes_palette_id = palette.id;
+}
+
+// Formats "\033[48;5;Nm" and "\033[38;5;Nm" for the 256 colors, "\033[4Nm" and "\033[3Nm" (or "\033[10Nm" and
+// "\033[9Nm" when bright) for the 16 colors.
+void FrameRenderer::build_fixed_escapes() {
+    size_t count = options.color_mode == ColorMode::COLORS_256 ? 256 : 16;
+    for (size_t i = 0; i < count; ++i) {
+        if (options.color_mode == ColorMode::COLORS_256) {
+            format_escape(background_escapes[i], "48;5;", &i, 1);
+            format_escape(foreground_escapes[i], "38;5;", &i, 1);
+        } else {
+            size_t background = i < 8 ? 40 + i : 100 + i - 8;
+            size_t foreground = i < 8 ? 30 + i : 90 + i - 8;
+            format_escape(background_escapes[i], "", &background, 1);
+            format_escape(foreground_escapes[i], "", &foreground, 1);
+        }
+    }
+}
+
+// Compares the nearest cube color (levels 0, 95, 135, 175, 215, 255) with the nearest gray (8, 18, ..., 238).
+uint8_t FrameRenderer::nearest_256_color(const Color& color) {
+    static const int levels[6] = {0, 95, 135, 175, 215, 255};
+    const int components[3] = {color.r, color.g, color.b};
+    int cube_index = 0, cube_distance = 0;
+    for (int component : components) {
+        int level = component < 48 ? 0 : component < 116 ? 1 : (component - 36) / 40;  // ties to the darker level
+        cube_index = cube_index * 6 + level;
+        cube_distance += (component - levels[level]) * (component - levels[level]);
+    }
+    int sum = color.r + color.g + color.b;  // the nearest gray is the nearest to the average
+    int gray_index = std::min(23, std::max(0, (sum - 10) / 30));
+    int gray = 8 + 10 * gray_index;
+    int gray_distance = 0;
+    for (int component : components) {
+        gray_distance += (component - gray) * (component - gray);
+    }
+    return static_cast<uint8_t>(gray_distance < cube_distance ? 232 + gray_index : 16 + cube_index);
+}
+
+// Searches the 16 colors with their xterm default values.
+uint8_t FrameRenderer::nearest_16_color(const Color& color) {
+    static const Color ansi_colors[16] = {
+        Color(0, 0, 0), Color(205, 0, 0), Color(0, 205, 0), Color(205, 205, 0),
+        Color(0, 0, 238), Color(205, 0, 205), Color(0, 205, 205), Color(229, 229, 229),
+        Color(127, 127, 127), Color(255, 0, 0), Color(0, 255, 0), Color(255, 255, 0),
+        Color(92, 92, 255), Color(255, 0, 255), Color(0, 255, 255), Color(255, 255, 255)
+    };
+    uint8_t nearest = 0;
+    int nearest_distance = -1;
+    for (uint8_t i = 0; i < 16; ++i) {
+        int r = color.r - ansi_colors[i].r, g = color.g - ansi_colors[i].g, b = color.b - ansi_colors[i].b;
+        int distance = r * r + g * g + b * b;
+        if (nearest_distance < 0 || distance < nearest_distance) {
+            nearest = i;
+            nearest_distance = distance;
+        }
+    }
+    return nearest;
+}
+
+// Writes "\033[", the introducer, the numbers separated by ';' and 'm'.
+void FrameRenderer::format_escape(Escape& escape, const char* introducer, const size_t* numbers, const size_t count) {
+    char* destination = escape.bytes;
+    *destination++ = '\033';
+    *destination++ = '[';
+    size_t introducer_length = std::strlen(introducer);
+    std::memcpy(destination, introducer, introducer_length);
+    destination += introducer_length;
+    for (size_t i = 0; i < count; ++i) {
+        if (i > 0) {
+            *destination++ = ';';
+        }
+        destination += format_number(destination, numbers[i]);
+    }
+    *destination++ = 'm';
+    escape.length = static_cast<uint8_t>(destination - escape.bytes);
+}
+
+// Writes a number in decimal, without going through a stream.
+size_t FrameRenderer::format_number(char* destination, size_t number) {
+    char digits[20];
+    size_t length = 0;
+    do {
+        digits[length++] = static_cast<char>('0' + number % 10);
+        number /= 10;
+    } while (number > 0);
+    for (size_t i = 0; i < length; ++i) {
+        destination[i] = digits[length - 1 - i];
+    }
+    return length;
+}
@@ -0,0 +1,71 @@
+#include "frame_pacer.h"
+#include <thread>
+#include <algorithm>
+
+#ifdef __linux__
+#include <time.h>
+#include <cerrno>
+#endif
+
+const size_t JitterHistogram::BUCKETS;
+const long long JitterHistogram::UPPER_BOUNDS_US[BUCKETS - 1] = {50, 100, 250, 500, 1000, 2000, 5000};
+
+void JitterHistogram::record(const std::chrono::steady_clock::duration error) {
+    long long error_us = std::chrono::duration_cast<std::chrono::microseconds>(error).count();
+    size_t bucket = std::upper_bound(UPPER_BOUNDS_US, UPPER_BOUNDS_US + BUCKETS - 1, error_us) - UPPER_BOUNDS_US;
+    counts[bucket]++;
+    samples++;
+    total_us += error_us;
+    max_us = std::max(max_us, error_us);
+}
+
+void JitterHistogram::print(std::ostream& os) const {
+    os << "frame start jitter: " << (samples ? total_us / static_cast<long long>(samples) : 0) << " us on average, "
+       << max_us << " us at most\n";
+    for (size_t i = 0; i < BUCKETS; ++i) {
+        os << "  ";
+        if (i < BUCKETS - 1) {
+            os << "< " << UPPER_BOUNDS_US[i];
+        } else {
+            os << ">= " << UPPER_BOUNDS_US[BUCKETS - 2];
+        }
+        os << " us: " << counts[i] << "\n";
+    }
+}
+
+// Sleeps to the start of the spin tail, then busy-waits the deadline.
+void FramePacer::wait_until(const clock::time_point deadline) {
+    if (clock::now() >= deadline) {
+        return;  // late: there is nothing to wait for (the caller handles late frames)
+    }
+    if (spin > clock::duration::zero()) {
+        sleep_until(deadline - spin);
+    } else {
+        sleep_until(deadline);
+    }
+    clock::time_point now = clock::now();
+    while (now < deadline) {
+        now = clock::now();
+    }
+    jitter.record(now - deadline);
+}
+
+#ifdef __linux__
+// steady_clock is CLOCK_MONOTONIC: its time points convert directly to an absolute timespec.
+void FramePacer::sleep_until(const clock::time_point time_point) {
+    auto since_epoch = std::chrono::duration_cast<std::chrono::nanoseconds>(time_point.time_since_epoch()).count();
+    if (since_epoch <= 0) {
+        return;
+    }
+    struct timespec deadline;
+    deadline.tv_sec = static_cast<time_t>(since_epoch / 1000000000);
+    deadline.tv_nsec = static_cast<long>(since_epoch % 1000000000);
+    while (clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &deadline, nullptr) == EINTR) {
+        // interrupted by a signal: sleep again to the same absolute deadline
+    }
+}
+#else
+void FramePacer::sleep_until(const clock::time_point time_point) {
+    std::this_thread::sleep_until(time_point);
+}
+#endif
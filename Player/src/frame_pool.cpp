@@ -0,0 +1,85 @@
+#include "frame_pool.h"
+
+FrameHandle& FrameHandle::operator=(FrameHandle&& other) {
+    if (this != &other) {
+        release();
+        frame = other.frame;
+        pool = other.pool;
+        other.frame = nullptr;
+        other.pool = nullptr;
+    }
+    return *this;
+}
+
+void FrameHandle::release() {
+    if (frame) {
+        pool->recycle(frame);
+        frame = nullptr;
+        pool = nullptr;
+    }
+}
+
+void FramePool::setup(const size_t width, const size_t height, const size_t reserved) {
+    std::lock_guard<std::mutex> lock(mutex);
+    this->width = width;
+    this->height = height;
+    frames.clear();
+    free_frames.clear();
+    frames.reserve(reserved);
+    free_frames.reserve(reserved);
+    for (size_t i = 0; i < reserved; ++i) {
+        free_frames.push_back(allocate_frame());
+    }
+    // Each frame refers to at most one palette, plus the one being filled for the next cluster
+    palettes.clear();
+    next_palette = 0;
+    for (size_t i = 0; i < reserved + 1; ++i) {
+        palettes.push_back(std::make_shared<Palette>());
+    }
+}
+
+FrameHandle FramePool::acquire() {
+    std::lock_guard<std::mutex> lock(mutex);
+    if (free_frames.empty()) {
+        // Every frame is in use: grow the pool (released frames must always fit in the free list)
+        Frame* frame = allocate_frame();
+        free_frames.reserve(frames.size());
+        return FrameHandle(frame, this);
+    }
+    Frame* frame = free_frames.back();
+    free_frames.pop_back();
+    return FrameHandle(frame, this);
+}
+
+std::shared_ptr<Palette> FramePool::acquire_palette() {
+    // Frames release their palette under the lock: a count of 1 means no frame refers to the palette anymore
+    std::lock_guard<std::mutex> lock(mutex);
+    for (size_t i = 0; i < palettes.size(); ++i) {
+        size_t index = (next_palette + i) % palettes.size();
+        if (palettes[index].use_count() == 1) {
+            next_palette = index + 1;
+            palettes[index]->id = next_palette_id++;  // new content: renderers must not reuse what they derived from it
+            return palettes[index];
+        }
+    }
+    palettes.push_back(std::make_shared<Palette>());
+    palettes.back()->id = next_palette_id++;
+    return palettes.back();
+}
+
+size_t FramePool::size() const {
+    std::lock_guard<std::mutex> lock(mutex);
+    return frames.size();
+}
+
+void FramePool::recycle(Frame* frame) {
+    std::lock_guard<std::mutex> lock(mutex);
+    frame->palette.reset();  // the palette can be reused once no frame refers to it
+    free_frames.push_back(frame);  // never reallocates: capacity >= frames.size()
+}
+
+Frame* FramePool::allocate_frame() {
+    std::unique_ptr<Frame> frame(new Frame(width, height));
+    frames.push_back(std::move(frame));
+    return frames.back().get();
+}
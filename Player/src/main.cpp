@@ -1,23 +1,71 @@
 #include <iostream>
 #include <string>
+#include <stdexcept>
 #include "clim_player.h"
+#ifdef _WIN32
+#include <windows.h>
+#endif
 
 using namespace std;
 
 int main(int argc, char* argv[]) {
     try {
     	bool loop = false;
+    	bool show_stats = false;
+    	bool synchronized_updates = true;
         string clim_filepath = "";  // Not-set clim filepath
+        PlayerOptions options;
+        options.render.color_mode = FrameRenderer::detect_color_mode();  // Colors supported by the terminal (unless forced)
         
-        if (argc > 1 && argc <= 3) {  // Or (if provided)
-	        for (int i = 1; i < argc; ++i) {
-	            std::string arg = argv[i];
-	            if (arg == "--loop") {
-	                loop = true;  // Enable loop for optional arg "--loop"
-	            } else {
-	                clim_filepath = arg;  // Desired filepath
-	            }
-	        }
+        for (int i = 1; i < argc; ++i) {  // Or (if provided)
+            std::string arg = argv[i];
+            if (arg == "--loop") {
+                loop = true;  // Enable loop for optional arg "--loop"
+            } else if (arg == "--stats") {
+                show_stats = true;  // Print playback statistics at the end for optional arg "--stats"
+            } else if (arg == "--buffer" && i + 1 < argc) {
+                options.buffer_frames = stoul(argv[++i]);  // Depth of the decoded frames queue
+            } else if (arg == "--buffer-bytes" && i + 1 < argc) {
+                options.buffer_bytes = stoul(argv[++i]);  // Depth of the decoded frames queue in bytes (unless --buffer)
+            } else if (arg == "--decode-threads" && i + 1 < argc) {
+                options.decode_threads = stoul(argv[++i]);  // Threads decoding frames (0: one per core)
+            } else if (arg == "--half-blocks") {
+                options.render.strategy = RenderStrategy::HALF_BLOCKS;  // Draw two pixels per cell with upper half blocks
+            } else if (arg == "--colors" && i + 1 < argc) {
+                string mode = argv[++i];  // Colors supported by the terminal
+                if (mode == "truecolor") {
+                    options.render.color_mode = ColorMode::TRUE_COLOR;
+                } else if (mode == "256") {
+                    options.render.color_mode = ColorMode::COLORS_256;
+                } else if (mode == "16") {
+                    options.render.color_mode = ColorMode::COLORS_16;
+                } else {
+                    throw invalid_argument("Unknown color mode: " + mode);
+                }
+            } else if (arg == "--late-policy" && i + 1 < argc) {
+                string policy = argv[++i];  // What to do with the frames that cannot be displayed on time
+                if (policy == "drop") {
+                    options.late_policy = LatePolicy::DROP;
+                } else if (policy == "slow") {
+                    options.late_policy = LatePolicy::SLOW_MOTION;
+                } else if (policy == "adaptive") {
+                    options.late_policy = LatePolicy::ADAPTIVE;
+                } else {
+                    throw invalid_argument("Unknown late policy: " + policy);
+                }
+            } else if (arg == "--spin" && i + 1 < argc) {
+                options.spin_us = stoul(argv[++i]);  // Microseconds busy-waited before each frame start
+            } else if (arg == "--no-adapt") {
+                options.adapt_output = false;  // Keep the rendering settings even if the output cannot keep up
+            } else if (arg == "--no-sync") {
+                synchronized_updates = false;  // Do not wrap frames in synchronized update markers
+            } else if (arg == "--no-coalesce") {
+                options.render.escape_mode = EscapeMode::PER_PIXEL;  // Emit a color escape code before every pixel
+            } else if (arg == "--redraw-threshold" && i + 1 < argc) {
+                options.render.redraw_threshold = stod(argv[++i]);  // Fraction of changed cells causing a full redraw
+            } else {
+                clim_filepath = arg;  // Desired filepath
+            }
         }
         
         if (clim_filepath == "") {  // Explicitly require an input CLIM file
@@ -25,15 +73,37 @@ int main(int argc, char* argv[]) {
         	cin >> clim_filepath;
 		}
         
+#ifdef _WIN32
+        if (options.render.strategy == RenderStrategy::HALF_BLOCKS) {
+            SetConsoleOutputCP(CP_UTF8);  // The half blocks are written in UTF-8
+        }
+#endif
+
 		// Create a CLIMPlayer instance and play the desired file
-        CLIMPlayer player("", clim_filepath);
-        player.play(cout, loop);
+        CLIMPlayer player("", clim_filepath, options);
+        OutputSink output(synchronized_updates);  // Frames are written straight to the standard output
+        player.play(output, loop);
+        if (show_stats) {
+            cerr << player.get_stats();
+        }
 
     } catch (const exception& e) {  // catch all the error/exceptions
         cerr << "Fatal error: " << e.what() << "\n"
         	 << "Remember to use the correct syntax and to provide a valid CLIM file as input.\n"
-			 << "Syntax: player [--loop] [input]\n"
+			 << "Syntax: player [--loop] [--stats] [--buffer FRAMES] [--buffer-bytes BYTES] [--decode-threads N] [--half-blocks] [--colors MODE] [--late-policy POLICY] [--spin MICROSECONDS] [--no-adapt] [--no-sync] [--no-coalesce] [--redraw-threshold FRACTION] [input]\n"
         	 << "  [--loop]: loop the video. Optional.\n"
+        	 << "  [--stats]: print playback statistics when the video ends. Optional.\n"
+        	 << "  [--buffer FRAMES]: number of frames decoded ahead (default: 4 seconds of video). Optional.\n"
+        	 << "  [--buffer-bytes BYTES]: memory for the frames decoded ahead, a byte per pixel (ignored with --buffer). Optional.\n"
+        	 << "  [--decode-threads N]: number of threads decoding frames, beyond 1 the upcoming clusters are decoded in parallel (default: 1, 0: one per core). Optional.\n"
+        	 << "  [--half-blocks]: draw two pixels per character with upper half blocks, doubling the vertical resolution (needs a UTF-8 terminal). Optional.\n"
+        	 << "  [--colors MODE]: colors of the terminal, truecolor, 256 or 16 (default: detected from COLORTERM and TERM). Optional.\n"
+        	 << "  [--late-policy POLICY]: frames that cannot be displayed on time are dropped (drop), delay the next ones (slow), or are caught up on short delays and dropped on longer ones (adaptive, default). Optional.\n"
+        	 << "  [--spin MICROSECONDS]: busy-wait the end of the wait before each frame, for a more accurate frame start (default: 0). Optional.\n"
+        	 << "  [--no-adapt]: keep the rendering settings when the terminal cannot keep up (by default, frames are skipped while output is queued and the rendering switches to coalesced deltas, then 256 colors, then 16 colors). Optional.\n"
+        	 << "  [--no-sync]: do not wrap frames in synchronized update markers (terminal mode 2026). Optional.\n"
+        	 << "  [--no-coalesce]: emit a color escape code before every pixel, not only when the color changes. Optional.\n"
+        	 << "  [--redraw-threshold FRACTION]: redraw frames in full when more than this fraction of cells changed, only the changes otherwise (default: 0.5, 0: always). Optional.\n"
         	 << "  [input]: is the clim file path to show. Optional (but it will be required when starting the program if not provided).\n"
         	 << "Press any key to continue...\n";
 		getchar();
@@ -0,0 +1,116 @@
+#include "output_sink.h"
+#include <iostream>
+#include <stdexcept>
+#include <cstring>
+#include <cerrno>
+
+#ifdef _WIN32
+#include <windows.h>
+#include <io.h>
+#else
+#include <unistd.h>
+#include <poll.h>
+#include <sys/uio.h>
+#include <sys/ioctl.h>
+#endif
+
+const char OutputSink::SYNC_BEGIN[] = "\033[?2026h";
+const char OutputSink::SYNC_END[] = "\033[?2026l";
+const size_t OutputSink::SYNC_MARKER_LENGTH;
+
+OutputSink::OutputSink(const bool synchronized_updates)
+    : terminal(is_terminal()), synchronized_updates(synchronized_updates && terminal) {
+    std::cout.flush();  // keep the order with what has been written through std::cout
+}
+
+#ifdef _WIN32
+// Copies the frame between the markers if needed, then writes it with WriteFile.
+void OutputSink::write_frame(const std::string& frame) {
+    clock::time_point start = clock::now();
+    const char* data = frame.data();
+    size_t size = frame.size();
+    if (synchronized_updates) {
+        buffer.assign(SYNC_BEGIN, SYNC_MARKER_LENGTH);
+        buffer.append(frame);
+        buffer.append(SYNC_END, SYNC_MARKER_LENGTH);
+        data = buffer.data();
+        size = buffer.size();
+    }
+    HANDLE handle = GetStdHandle(STD_OUTPUT_HANDLE);
+    while (size > 0) {
+        DWORD written = 0;
+        ++write_calls;
+        if (!WriteFile(handle, data, static_cast<DWORD>(size), &written, nullptr)) {
+            throw std::runtime_error("Cannot write to the standard output");
+        }
+        data += written;
+        size -= written;
+    }
+    last_write_time = clock::now() - start;
+    write_time += last_write_time;
+}
+
+size_t OutputSink::queued_bytes() const {
+    return 0;
+}
+
+bool OutputSink::is_terminal() {
+    return _isatty(_fileno(stdout)) != 0;
+}
+#else
+// Gathers the markers and the frame with writev, without copying them.
+void OutputSink::write_frame(const std::string& frame) {
+    clock::time_point start = clock::now();
+    struct iovec pieces[3] = {
+        {const_cast<char*>(SYNC_BEGIN), SYNC_MARKER_LENGTH},
+        {const_cast<char*>(frame.data()), frame.size()},
+        {const_cast<char*>(SYNC_END), SYNC_MARKER_LENGTH}
+    };
+    struct iovec* piece = synchronized_updates ? pieces : pieces + 1;
+    int count = synchronized_updates ? 3 : 1;
+    while (count > 0) {
+        ++write_calls;
+        ssize_t written = writev(STDOUT_FILENO, piece, count);
+        if (written < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            if (errno == EAGAIN || errno == EWOULDBLOCK) {
+                // Non-blocking output: wait until it can take more bytes
+                struct pollfd output = {STDOUT_FILENO, POLLOUT, 0};
+                poll(&output, 1, -1);
+                continue;
+            }
+            throw std::runtime_error(std::string("Cannot write to the standard output: ") + std::strerror(errno));
+        }
+        // Partial write: skip the pieces written, then the written part of the next one
+        size_t remaining = static_cast<size_t>(written);
+        while (count > 0 && remaining >= piece->iov_len) {
+            remaining -= piece->iov_len;
+            ++piece;
+            --count;
+        }
+        if (count > 0) {
+            piece->iov_base = static_cast<char*>(piece->iov_base) + remaining;
+            piece->iov_len -= remaining;
+        }
+    }
+    last_write_time = clock::now() - start;
+    write_time += last_write_time;
+}
+
+// Asks the terminal driver (or the pipe) how many bytes the reader has not taken yet.
+size_t OutputSink::queued_bytes() const {
+#ifdef __linux__
+    int queued = 0;
+    if (ioctl(STDOUT_FILENO, terminal ? TIOCOUTQ : FIONREAD, &queued) == 0 && queued > 0) {
+        return static_cast<size_t>(queued);
+    }
+#endif
+    return 0;
+}
+
+bool OutputSink::is_terminal() {
+    return isatty(STDOUT_FILENO) != 0;
+}
+#endif